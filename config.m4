@@ -47,6 +47,16 @@ if test "$PHP_ZSTD" != "no"; then
     fi
     PHP_EVAL_LIBLINE($LIBZSTD_LIBDIR, ZSTD_SHARED_LIBADD)
     PHP_EVAL_INCLINE($LIBZSTD_CFLAGS)
+
+    dnl Frame headers, magicless frames and dictionaries by reference
+    dnl come from the experimental API
+    PHP_CHECK_LIBRARY(zstd, ZSTD_getFrameHeader, [
+      AC_DEFINE(HAVE_LIBZSTD, 1, [Whether the system libzstd is used])
+    ], [
+      AC_MSG_ERROR([system libzstd does not export the experimental API, use the bundled library])
+    ], [
+      $ZSTD_SHARED_LIBADD
+    ])
   else
     ZSTD_COMMON_SOURCES="
       zstd/lib/common/debug.c
@@ -85,6 +95,15 @@ if test "$PHP_ZSTD" != "no"; then
     PHP_ADD_INCLUDE(PHP_EXT_SRCDIR()/zstd/lib)
   fi
   PHP_NEW_EXTENSION(zstd, zstd.c $ZSTD_COMMON_SOURCES $ZSTD_COMPRESS_SOURCES $ZSTD_DECOMPRESS_SOURCES, $ext_shared)
+
+  dnl Threads for parallel decompression
+  AC_CHECK_HEADER(pthread.h, [
+    AC_CHECK_LIB(pthread, pthread_create, [
+      PHP_ADD_LIBRARY(pthread, , ZSTD_SHARED_LIBADD)
+      AC_DEFINE(HAVE_ZSTD_THREADS, 1, [Whether to enable parallel decompression])
+    ])
+  ])
+
   PHP_SUBST(ZSTD_SHARED_LIBADD)
 
   if test "$PHP_LIBZSTD" = "no"; then
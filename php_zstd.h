@@ -42,10 +42,53 @@ extern zend_module_entry zstd_module_entry;
 #include "TSRM.h"
 #endif
 
+#include <zend_smart_str_public.h>
+
+typedef struct _php_zstd_stats {
+    zend_ulong compress_calls;
+    zend_ulong bytes_in;
+    zend_ulong bytes_out;
+    zend_ulong incompressible;
+    zend_ulong incompressible_bytes;
+    zend_ulong cache_hits;
+    zend_ulong cache_misses;
+} php_zstd_stats;
+
+typedef struct _php_zstd_memo php_zstd_memo;
+
+ZEND_BEGIN_MODULE_GLOBALS(zstd)
+    char *dictionaries;
+    HashTable registered_dicts;
+    struct ZSTD_CCtx_s *cctx;
+    struct ZSTD_DCtx_s *dctx;
+    smart_str serialize_buf;
+    zend_bool serialize_busy;
+    char *scratch;
+    size_t scratch_size;
+    zend_bool scratch_busy;
+    php_zstd_stats stats;
+    zend_long cache_size;
+    HashTable memo;
+    HashTable memo_dicts;
+    php_zstd_memo *memo_head, *memo_tail;
+    php_zstd_memo *memo_locals;
+    size_t memo_bytes;
+    size_t memo_count;
+#if defined(HAVE_APCU_SUPPORT)
+    char *apcu_dictionary;
+#endif
+ZEND_END_MODULE_GLOBALS(zstd)
+
+ZEND_EXTERN_MODULE_GLOBALS(zstd)
+
 #ifdef ZTS
 #define PHP_ZSTD_G(v) TSRMG(zstd_globals_id, zend_zstd_globals *, v)
 #else
 #define PHP_ZSTD_G(v) (zstd_globals.v)
 #endif
 
+#if defined(ZTS) && defined(COMPILE_DL_ZSTD)
+ZEND_TSRMLS_CACHE_EXTERN()
+#endif
+
 #endif  /* PHP_ZSTD_H */
@@ -0,0 +1,39 @@
+--TEST--
+APCu compact serializer
+--INI--
+apc.enable_cli=1
+apc.serializer=zstd_compact
+--SKIPIF--
+<?php
+if (!extension_loaded('apcu')) {
+  echo 'skip need apcu';
+  die;
+}
+if (LIBZSTD_VERSION_NUMBER < 10400) die("skip needs libzstd 1.4.0");
+?>
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+
+echo ini_get('apc.serializer'), "\n";
+
+$value = array('data' => $data, 'int' => 10);
+apcu_store('foo', $value);
+var_dump(apcu_fetch('foo') === $value);
+
+apcu_store('small', array('id' => 1));
+var_dump(apcu_fetch('small'));
+
+apcu_store('nullval', null);
+var_dump(apcu_fetch('nullval'));
+?>
+===Done===
+--EXPECTF--
+zstd_compact
+bool(true)
+array(1) {
+  ["id"]=>
+  int(1)
+}
+NULL
+===Done===
@@ -0,0 +1,29 @@
+--TEST--
+APCu serializer with a preloaded dictionary
+--INI--
+apc.enable_cli=1
+apc.serializer=zstd
+zstd.dictionaries="data={PWD}/data.dic"
+zstd.apcu_dictionary=data
+--SKIPIF--
+<?php
+if (!extension_loaded('apcu')) {
+  echo 'skip need apcu';
+  die;
+}
+?>
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+
+echo ini_get('zstd.apcu_dictionary'), "\n";
+
+$value = array('data' => $data, 'int' => 10);
+apcu_store('foo', $value);
+var_dump(apcu_fetch('foo') === $value);
+?>
+===Done===
+--EXPECTF--
+data
+bool(true)
+===Done===
@@ -0,0 +1,101 @@
+--TEST--
+zstd_bench(): benchmark of compression levels
+--SKIPIF--
+<?php
+if (LIBZSTD_VERSION_NUMBER < 10400) die("skip needs libzstd 1.4.0");
+?>
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+$dictionary = file_get_contents(dirname(__FILE__) . '/data.dic');
+
+$samples = array($data, substr($data, 100), str_repeat($data, 3));
+$size = strlen($data) * 4 - 100;
+
+echo "Levels\n";
+
+$stats = zstd_stats();
+$result = zstd_bench($samples, array(1, 3, 9));
+var_dump($stats === zstd_stats());
+var_dump(count($result));
+foreach ($result as $entry) {
+  echo $entry['level'], ': ';
+  var_dump($entry['bytes_in'] === $size,
+           $entry['ratio'] > 1,
+           $entry['compress_mbps'] > 0,
+           $entry['decompress_latency']['p50'] <= $entry['decompress_latency']['max']);
+}
+var_dump(array_keys($result[0]['compress_latency']));
+
+echo "Options\n";
+
+$result = zstd_bench($data, array(), array('iterations' => 1, 'dict' => $dictionary));
+var_dump($result[0]['level'], $result[0]['bytes_out'] === strlen(zstd_compress_dict($data, $dictionary)));
+
+$result = zstd_bench($data, array(3), array('params' => array('checksum' => 1)));
+var_dump($result[0]['bytes_out'] === strlen(zstd_compress($data)) + 4);
+
+$result = zstd_bench($data, array(3), array('flags' => ZSTD_COMPRESS_COMPACT));
+var_dump($result[0]['bytes_out'] < strlen(zstd_compress($data)));
+
+echo "Errors\n";
+
+var_dump(zstd_bench(array()));
+var_dump(zstd_bench($data, array(100)));
+var_dump(zstd_bench($data, array(3), array('iterations' => 0)));
+var_dump(zstd_bench($data, array(3), array('iterations' => PHP_INT_MAX)));
+var_dump(zstd_bench($data, array(3), array('params' => array('foo' => 1))));
+var_dump(zstd_bench($data, array(3), array('flags' => ZSTD_COMPRESS_COMPACT, 'dict' => $dictionary)));
+?>
+===Done===
+--EXPECTF--
+Levels
+bool(true)
+int(3)
+1: bool(true)
+bool(true)
+bool(true)
+bool(true)
+3: bool(true)
+bool(true)
+bool(true)
+bool(true)
+9: bool(true)
+bool(true)
+bool(true)
+bool(true)
+array(4) {
+  [0]=>
+  string(3) "p50"
+  [1]=>
+  string(3) "p90"
+  [2]=>
+  string(3) "p99"
+  [3]=>
+  string(3) "max"
+}
+Options
+int(3)
+bool(true)
+bool(true)
+bool(true)
+Errors
+
+Warning: zstd_bench(): samples must not be empty in %s on line %d
+bool(false)
+
+Warning: zstd_bench(): compression level (100) must be within 1..%d or smaller then 0 in %s on line %d
+bool(false)
+
+Warning: zstd_bench(): iterations (0) must be greater than 0 in %s on line %d
+bool(false)
+
+Warning: zstd_bench(): iterations (%d) must not be greater than 10000 in %s on line %d
+bool(false)
+
+Warning: zstd_bench(): unknown parameter 'foo' in %s on line %d
+bool(false)
+
+Warning: zstd_bench(): flags can not be used with dict, workers or params in %s on line %d
+bool(false)
+===Done===
@@ -0,0 +1,52 @@
+--TEST--
+zstd_compress(): compact frames
+--SKIPIF--
+<?php
+if (LIBZSTD_VERSION_NUMBER < 10400) die("skip needs libzstd 1.4.0");
+?>
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+
+$value = serialize(array('id' => 123, 'name' => 'Hamlet', 'act' => 3));
+
+echo "*** Compact ***", PHP_EOL;
+$compact = zstd_compress($value, 3, ZSTD_COMPRESS_COMPACT);
+var_dump(strlen($compact) < strlen(zstd_compress($value)));
+var_dump(zstd_uncompress($compact) === $value);
+var_dump(\Zstd\uncompress(\Zstd\compress($data, 19, ZSTD_COMPRESS_COMPACT)) === $data);
+var_dump(zstd_uncompress_parallel($compact) === $value);
+
+echo "*** Empty ***", PHP_EOL;
+var_dump(zstd_uncompress(zstd_compress('', 3, ZSTD_COMPRESS_COMPACT)));
+
+echo "*** Frame info ***", PHP_EOL;
+$info = zstd_get_frame_info($compact);
+var_dump($info['frames']);
+var_dump($info['content_size'] === strlen($value));
+var_dump($info['frame_sizes'] === array(strlen($compact)));
+$string = new Zstd\CompressedString($compact);
+var_dump($string->getFrameInfo() === $info);
+
+echo "*** Truncated ***", PHP_EOL;
+var_dump(zstd_uncompress(substr($compact, 0, -2)));
+?>
+===Done===
+--EXPECTF--
+*** Compact ***
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+*** Empty ***
+string(0) ""
+*** Frame info ***
+int(1)
+bool(true)
+bool(true)
+bool(true)
+*** Truncated ***
+
+Warning: zstd_uncompress(): can not decompress stream in %s on line %d
+bool(false)
+===Done===
@@ -0,0 +1,45 @@
+--TEST--
+zstd_compress_dict(): compact frames
+--SKIPIF--
+<?php
+if (LIBZSTD_VERSION_NUMBER < 10400) die("skip needs libzstd 1.4.0");
+?>
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+$dictionary = file_get_contents(dirname(__FILE__) . '/data.dic');
+
+$value = substr($data, 0, 200);
+
+echo "*** Compact ***", PHP_EOL;
+$compact = zstd_compress_dict($value, $dictionary, 3, ZSTD_COMPRESS_COMPACT);
+var_dump(strlen($compact) < strlen(zstd_compress($value, 3, ZSTD_COMPRESS_COMPACT)));
+var_dump(zstd_uncompress_dict($compact, $dictionary) === $value);
+var_dump(\Zstd\uncompress_dict(\Zstd\compress_dict($data, $dictionary, 19, ZSTD_COMPRESS_COMPACT), $dictionary) === $data);
+
+echo "*** Other dictionary ***", PHP_EOL;
+// Without the checksum the frame would decode into upper case text
+$raw = substr($data, 0, 1024);
+$compact = zstd_compress_dict($value, $raw, 3, ZSTD_COMPRESS_COMPACT);
+var_dump(zstd_uncompress_dict($compact, $raw) === $value);
+var_dump(zstd_uncompress_dict($compact, strtoupper($raw)));
+
+echo "*** No dictionary ***", PHP_EOL;
+var_dump(zstd_uncompress($compact));
+?>
+===Done===
+--EXPECTF--
+*** Compact ***
+bool(true)
+bool(true)
+bool(true)
+*** Other dictionary ***
+bool(true)
+
+Warning: zstd_uncompress_dict(): can not decompress stream in %s on line %d
+bool(false)
+*** No dictionary ***
+
+Warning: zstd_uncompress(): can not decompress stream in %s on line %d
+bool(false)
+===Done===
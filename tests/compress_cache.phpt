@@ -0,0 +1,80 @@
+--TEST--
+zstd_compress(): cache of compressed results
+--INI--
+zstd.cache_size=65536
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+
+$dictionary = file_get_contents(dirname(__FILE__) . '/data.dic');
+
+$stats = zstd_stats();
+
+echo "Level\n";
+$compressed = zstd_compress($data);
+var_dump($compressed === zstd_compress($data));
+var_dump($compressed !== zstd_compress($data, 9));
+var_dump(zstd_uncompress(zstd_compress($data)) === $data);
+
+echo "Dictionary\n";
+$compressed = zstd_compress_dict($data, $dictionary);
+var_dump($compressed === zstd_compress_dict($data, $dictionary));
+var_dump(zstd_uncompress_dict(zstd_compress_dict($data, $dictionary),
+                              $dictionary) === $data);
+$other = substr($data, 0, 1024);
+var_dump(zstd_uncompress_dict(zstd_compress_dict($data, $other),
+                              $other) === $data);
+
+echo "Object\n";
+$object = Zstd\CompressedString::compress($data);
+var_dump($object->getCompressed() === zstd_compress($data));
+
+echo "Too large\n";
+$large = str_repeat($data, 10);
+var_dump(zstd_uncompress(zstd_compress($large)) === $large);
+var_dump(zstd_uncompress(zstd_compress($large)) === $large);
+
+$after = zstd_stats();
+var_dump($after['cache_hits'] - $stats['cache_hits']);
+var_dump($after['cache_misses'] - $stats['cache_misses']);
+var_dump($after['cache_entries']);
+
+echo "Eviction\n";
+for ($i = 0; $i < 100; $i++) {
+  zstd_compress($data . $i);
+}
+$after = zstd_stats();
+var_dump($after['cache_entries'] < 100);
+var_dump($after['cache_bytes'] <= 65536);
+
+$stats = $after;
+var_dump(zstd_uncompress(zstd_compress($data)) === $data);
+$after = zstd_stats();
+var_dump($after['cache_hits'] - $stats['cache_hits']);
+var_dump($after['cache_misses'] - $stats['cache_misses']);
+?>
+===Done===
+--EXPECT--
+Level
+bool(true)
+bool(true)
+bool(true)
+Dictionary
+bool(true)
+bool(true)
+bool(true)
+Object
+bool(true)
+Too large
+bool(true)
+bool(true)
+int(6)
+int(6)
+int(4)
+Eviction
+bool(true)
+bool(true)
+bool(true)
+int(0)
+int(1)
+===Done===
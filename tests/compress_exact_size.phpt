@@ -0,0 +1,50 @@
+--TEST--
+zstd_compress(): results are allocated at their exact size
+--SKIPIF--
+<?php
+if (getenv('USE_ZEND_ALLOC') === '0') die("skip needs Zend memory manager");
+?>
+--INI--
+memory_limit=256M
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+
+echo "Large\n";
+
+$input = random_bytes(8 * 1024 * 1024);
+$before = memory_get_usage();
+$compressed = zstd_compress($input);
+$used = memory_get_usage() - $before;
+var_dump($used < strlen($compressed) + 8192);
+var_dump(zstd_uncompress($compressed) === $input);
+
+echo "Small\n";
+
+$results = array();
+for ($i = 0; $i < 100; $i++) {
+  $results[] = zstd_compress($data . $i);
+}
+foreach ($results as $i => $result) {
+  if (zstd_uncompress($result) !== $data . $i) {
+    echo "Error: $i\n";
+  }
+}
+var_dump(count(array_unique($results)));
+
+echo "Dictionary\n";
+
+$dictionary = file_get_contents(dirname(__FILE__) . '/data.dic');
+$compressed = zstd_compress_dict($data, $dictionary);
+var_dump(zstd_uncompress_dict($compressed, $dictionary) === $data);
+?>
+===Done===
+--EXPECT--
+Large
+bool(true)
+bool(true)
+Small
+int(100)
+Dictionary
+bool(true)
+===Done===
@@ -0,0 +1,102 @@
+--TEST--
+Zstd\CompressedString: lazy decompression
+--SKIPIF--
+<?php
+if (PHP_VERSION_ID < 70400) die("skip needs PHP 7.4");
+?>
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+
+$compressed = zstd_compress($data);
+
+echo "Lazy\n";
+
+$string = new Zstd\CompressedString($compressed);
+var_dump($string->isCached());
+var_dump($string->getSize() === strlen($data));
+var_dump($string->getCompressed() === $compressed);
+var_dump($string->getFrameInfo()['frames']);
+var_dump($string->isCached());
+var_dump((string) $string === $data);
+var_dump($string->isCached());
+var_dump($string->getContents() === $data);
+
+echo "No cache\n";
+
+$string = new Zstd\CompressedString($compressed, false);
+var_dump($string->getContents() === $data);
+var_dump($string->isCached());
+
+echo "Compress\n";
+
+$string = Zstd\CompressedString::compress($data, 9);
+var_dump($string instanceof Zstd\CompressedString);
+var_dump($string->getCompressed() === zstd_compress($data, 9));
+var_dump("$string" === $data);
+
+echo "Clone\n";
+
+$clone = clone $string;
+var_dump($clone->isCached());
+var_dump($clone->getContents() === $data);
+
+echo "Serialize\n";
+
+$serialized = serialize($string);
+var_dump(strlen($serialized) < strlen($data));
+$string = unserialize($serialized);
+var_dump($string->isCached());
+var_dump($string->getContents() === $data);
+
+echo "Errors\n";
+
+try {
+  new Zstd\CompressedString('foo');
+} catch (Error $e) {
+  echo $e->getMessage(), "\n";
+}
+try {
+  unserialize('O:21:"Zstd\CompressedString":1:{i:0;s:3:"foo";}');
+} catch (Error $e) {
+  echo $e->getMessage(), "\n";
+}
+$string = new Zstd\CompressedString(substr($compressed, 0, -10));
+try {
+  echo $string;
+} catch (Error $e) {
+  echo $e->getMessage(), "\n";
+}
+?>
+===Done===
+--EXPECTF--
+Lazy
+bool(false)
+bool(true)
+bool(true)
+int(1)
+bool(false)
+bool(true)
+bool(true)
+bool(true)
+No cache
+bool(true)
+bool(false)
+Compress
+bool(true)
+bool(true)
+bool(true)
+Clone
+bool(true)
+bool(true)
+Serialize
+bool(true)
+bool(false)
+bool(true)
+Errors
+Data was not compressed by zstd
+Invalid serialization data for Zstd\CompressedString object
+
+Warning: %s in %s on line %d
+Data can not be decompressed
+===Done===
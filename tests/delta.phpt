@@ -0,0 +1,56 @@
+--TEST--
+zstd_compress_delta(): compression against a reference string
+--SKIPIF--
+<?php
+if (LIBZSTD_VERSION_NUMBER < 10400) die("skip needs libzstd 1.4.0");
+?>
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+
+$base = str_repeat($data, 32);
+$new = substr_replace($base, 'Hamlet, Act III', 50000, 0);
+
+echo "*** Delta ***", PHP_EOL;
+$patch = zstd_compress_delta($new, $base);
+var_dump(strlen($patch) < strlen(zstd_compress($new)));
+var_dump(zstd_uncompress_delta($patch, $base) === $new);
+var_dump(\Zstd\uncompress_delta(\Zstd\compress_delta($new, $base, 19), $base) === $new);
+
+echo "*** Empty ***", PHP_EOL;
+var_dump(zstd_uncompress_delta(zstd_compress_delta('', $base), $base));
+
+echo "*** Wrong base ***", PHP_EOL;
+var_dump(zstd_uncompress_delta($patch, $data));
+
+echo "*** Invalid ***", PHP_EOL;
+var_dump(zstd_uncompress_delta('message string', $base));
+
+echo "*** Too large ***", PHP_EOL;
+// Frame header declaring a content size above the string size limit
+$frame = "\x28\xb5\x2f\xfd\xc0\x00\xf0" . str_repeat("\xff", 7) . "\x01\x00\x00";
+var_dump(zstd_uncompress_delta($frame, $base));
+var_dump(zstd_uncompress($frame));
+?>
+===Done===
+--EXPECTF--
+*** Delta ***
+bool(true)
+bool(true)
+bool(true)
+*** Empty ***
+string(0) ""
+*** Wrong base ***
+
+Warning: zstd_uncompress_delta(): %s in %s on line %d
+bool(false)
+*** Invalid ***
+
+Warning: zstd_uncompress_delta(): it was not compressed by zstd in %s on line %d
+bool(false)
+*** Too large ***
+
+Warning: zstd_uncompress_delta(): content size is too large in %s on line %d
+bool(false)
+string(0) ""
+===Done===
@@ -0,0 +1,50 @@
+--TEST--
+zstd.dictionaries: preloaded dictionaries
+--INI--
+zstd.dictionaries="data = {PWD}/data.dic"
+--SKIPIF--
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+$dictionary = file_get_contents(dirname(__FILE__) . '/data.dic');
+
+echo "*** Functions ***", PHP_EOL;
+$output = zstd_compress_dict($data, 'data');
+var_dump($output === zstd_compress_dict($data, $dictionary));
+var_dump(zstd_uncompress_dict($output, 'data') === $data);
+var_dump(zstd_uncompress_dict($output, $dictionary) === $data);
+$output = zstd_compress_dict($data, 'data', 9);
+var_dump(zstd_uncompress_dict($output, 'data') === $data);
+
+echo "*** Unknown name ***", PHP_EOL;
+$output = zstd_compress_dict($data, 'missing');
+var_dump(zstd_uncompress_dict($output, 'missing') === $data);
+var_dump(zstd_get_frame_info($output)['dict_id']);
+
+if (LIBZSTD_VERSION_NUMBER >= 10400) {
+  echo "*** Streams ***", PHP_EOL;
+  $file = dirname(__FILE__) . '/data_' . basename(__FILE__, ".php") . '.out';
+  $ctx = stream_context_create(array("zstd" => array("dict" => "data")));
+  var_dump(file_put_contents('compress.zstd://' . $file, $data, 0, $ctx) == strlen($data));
+  var_dump(zstd_uncompress_dict(file_get_contents($file), $dictionary) === $data);
+  var_dump(file_get_contents('compress.zstd://' . $file, false, $ctx) === $data);
+  @unlink($file);
+} else {
+  echo "*** Streams ***", PHP_EOL, "bool(true)", PHP_EOL, "bool(true)", PHP_EOL, "bool(true)", PHP_EOL;
+}
+?>
+===Done===
+--EXPECTF--
+*** Functions ***
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+*** Unknown name ***
+bool(true)
+int(0)
+*** Streams ***
+bool(true)
+bool(true)
+bool(true)
+===Done===
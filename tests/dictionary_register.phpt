@@ -0,0 +1,92 @@
+--TEST--
+zstd_dict_register(): decompression by dictionary ID
+--SKIPIF--
+<?php
+if (LIBZSTD_VERSION_NUMBER < 10500) die("skip needs libzstd 1.5.0");
+?>
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+$old = file_get_contents(dirname(__FILE__) . '/data.dic');
+// Same dictionary content, rotated to another dictionary ID
+$new = substr_replace($old, pack('V', 1234567), 4, 4);
+
+$old_data = zstd_compress_dict($data, $old);
+$new_data = zstd_compress_dict($data, $new);
+
+echo "*** Not registered ***", PHP_EOL;
+var_dump(zstd_uncompress($new_data));
+
+echo "*** Register ***", PHP_EOL;
+var_dump(zstd_dict_register($old));
+var_dump(\Zstd\dict_register($new));
+var_dump(zstd_dict_register($new));
+
+echo "*** Uncompress ***", PHP_EOL;
+var_dump(zstd_uncompress($old_data) === $data);
+var_dump(zstd_uncompress($new_data) === $data);
+var_dump(zstd_uncompress($old_data . $new_data) === $data . $data);
+var_dump(zstd_uncompress_parallel($new_data . $old_data, 2) === $data . $data);
+var_dump(zstd_uncompress(zstd_compress($data)) === $data);
+var_dump(zstd_uncompress(zstd_compress($data) . $new_data) === $data . $data);
+$value = array('id' => 1, 'data' => $data);
+var_dump(zstd_unserialize(zstd_compress('') . zstd_compress_dict(serialize($value), $new)) === $value);
+
+echo "*** Stream ***", PHP_EOL;
+$file = dirname(__FILE__) . '/dictionary_register.zst';
+file_put_contents($file, $new_data . $old_data);
+var_dump(file_get_contents('compress.zstd://' . $file) === $data . $data);
+file_put_contents($file, zstd_compress($data) . $new_data);
+var_dump(file_get_contents('compress.zstd://' . $file) === $data . $data);
+@unlink($file);
+
+echo "*** No dictionary ID ***", PHP_EOL;
+var_dump(zstd_dict_register($data));
+
+echo "*** Conflict ***", PHP_EOL;
+var_dump(zstd_dict_register(substr($new, 0, -1) . 'x'));
+var_dump(zstd_dict_register($new));
+
+echo "*** Limit ***", PHP_EOL;
+for ($id = 1000; $id < 1100; $id++) {
+  if (!zstd_dict_register(substr_replace($old, pack('V', $id), 4, 4))) {
+    break;
+  }
+}
+var_dump($id - 1000);
+?>
+===Done===
+--EXPECTF--
+*** Not registered ***
+
+Warning: zstd_uncompress(): can not decompress stream in %s on line %d
+bool(false)
+*** Register ***
+int(2033365437)
+int(1234567)
+int(1234567)
+*** Uncompress ***
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+*** Stream ***
+bool(true)
+bool(true)
+*** No dictionary ID ***
+
+Warning: zstd_dict_register(): dictionary has no dictionary ID in %s on line %d
+bool(false)
+*** Conflict ***
+
+Warning: zstd_dict_register(): dictionary ID 1234567 is already registered with another dictionary in %s on line %d
+bool(false)
+int(1234567)
+*** Limit ***
+
+Warning: zstd_dict_register(): can not register more than 64 dictionaries in %s on line %d
+int(62)
+===Done===
@@ -0,0 +1,100 @@
+--TEST--
+zstd_compress_file(): file to file compression
+--INI--
+zstd.dictionaries="data={PWD}/data.dic"
+--SKIPIF--
+<?php
+if (LIBZSTD_VERSION_NUMBER < 10400) die("skip needs libzstd 1.4.0");
+?>
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+$dictionary = file_get_contents(dirname(__FILE__) . '/data.dic');
+
+$base = dirname(__FILE__) . '/data_' . basename(__FILE__, ".php");
+$input = str_repeat($data, 500);
+file_put_contents($base . '.in', $input);
+
+echo "*** Compression ***", PHP_EOL;
+$size = zstd_compress_file($base . '.in', $base . '.zst');
+var_dump($size === filesize($base . '.zst'));
+var_dump(zstd_uncompress(file_get_contents($base . '.zst')) === $input);
+var_dump(zstd_get_frame_info(file_get_contents($base . '.zst'))['content_size'] === strlen($input));
+
+echo "*** Decompression ***", PHP_EOL;
+var_dump(zstd_uncompress_file($base . '.zst', $base . '.out') === strlen($input));
+var_dump(file_get_contents($base . '.out') === $input);
+
+echo "*** Dictionary ***", PHP_EOL;
+$options = ['level' => 9, 'dict' => $dictionary];
+var_dump(zstd_compress_file($base . '.in', $base . '.zst', $options) > 0);
+var_dump(zstd_uncompress_dict(file_get_contents($base . '.zst'), $dictionary) === $input);
+var_dump(\Zstd\uncompress_file($base . '.zst', $base . '.out', $options) === strlen($input));
+var_dump(file_get_contents($base . '.out') === $input);
+
+echo "*** Preloaded dictionary ***", PHP_EOL;
+var_dump(zstd_compress_file($base . '.in', $base . '.zst', ['dict' => 'data']) > 0);
+var_dump(zstd_uncompress_dict(file_get_contents($base . '.zst'), $dictionary) === $input);
+var_dump(zstd_uncompress_file($base . '.zst', $base . '.out', ['dict' => 'data']) === strlen($input));
+var_dump(file_get_contents($base . '.out') === $input);
+
+echo "*** Invalid ***", PHP_EOL;
+var_dump(zstd_uncompress_file($base . '.in', $base . '.out'));
+var_dump(@zstd_compress_file($base . '.none', $base . '.zst'));
+var_dump(zstd_compress_file($base . '.in', $base . '.zst', ['level' => 100]));
+$invalid = "\x37\xa4\x30\xec" . str_repeat('x', 100);
+var_dump(zstd_compress_file($base . '.in', $base . '.zst', ['dict' => $invalid]));
+var_dump(zstd_uncompress_file($base . '.zst', $base . '.out', ['dict' => $invalid]));
+
+echo "*** Empty ***", PHP_EOL;
+file_put_contents($base . '.in', '');
+var_dump(zstd_compress_file($base . '.in', $base . '.zst') > 0);
+var_dump(zstd_uncompress_file($base . '.zst', $base . '.out'));
+var_dump(file_get_contents($base . '.out'));
+var_dump(zstd_uncompress_file($base . '.in', $base . '.out'));
+
+@unlink($base . '.in');
+@unlink($base . '.zst');
+@unlink($base . '.out');
+?>
+===Done===
+--EXPECTF--
+*** Compression ***
+bool(true)
+bool(true)
+bool(true)
+*** Decompression ***
+bool(true)
+bool(true)
+*** Dictionary ***
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+*** Preloaded dictionary ***
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+*** Invalid ***
+
+Warning: zstd_uncompress_file(): %s in %s on line %d
+bool(false)
+bool(false)
+
+Warning: zstd_compress_file(): compression level (100) must be within 1..%d or smaller then 0 in %s on line %d
+bool(false)
+
+Warning: zstd_compress_file(): ZSTD_createCDict() error in %s on line %d
+bool(false)
+
+Warning: zstd_uncompress_file(): ZSTD_createDDict() error in %s on line %d
+bool(false)
+*** Empty ***
+bool(true)
+int(0)
+string(0) ""
+
+Warning: zstd_uncompress_file(): it was not compressed by zstd in %s on line %d
+bool(false)
+===Done===
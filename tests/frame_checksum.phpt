@@ -0,0 +1,83 @@
+--TEST--
+zstd_frame_checksum(): content checksum of frames
+--SKIPIF--
+<?php
+if (LIBZSTD_VERSION_NUMBER < 10400) die("skip needs libzstd 1.4.0");
+if (!in_array('xxh64', hash_algos())) die("skip needs xxh64");
+?>
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+
+$file = dirname(__FILE__) . '/data_' . basename(__FILE__, ".php") . '.out';
+$hash = hexdec(substr(hash('xxh64', $data), 8));
+
+echo "Compression\n";
+
+$compressed = zstd_compress($data, 3, ZSTD_COMPRESS_CHECKSUM);
+$info = zstd_get_frame_info($compressed);
+var_dump($info['checksum']);
+var_dump(zstd_frame_checksum($compressed) === $hash);
+var_dump(zstd_uncompress($compressed) === $data);
+var_dump(zstd_frame_checksum(zstd_compress($data)));
+
+$skippable = "\x50\x2a\x4d\x18" . pack('V', 3) . 'abc';
+var_dump(zstd_frame_checksum($skippable . $compressed) === $hash);
+
+$corrupted = substr($compressed, 0, -1) . chr(ord(substr($compressed, -1)) ^ 1);
+var_dump(@zstd_uncompress($corrupted));
+
+echo "Compact\n";
+
+$compressed = zstd_compress($data, 3,
+  ZSTD_COMPRESS_COMPACT | ZSTD_COMPRESS_CHECKSUM);
+var_dump(zstd_frame_checksum($compressed) === $hash);
+var_dump(zstd_uncompress($compressed) === $data);
+var_dump(zstd_frame_checksum(zstd_compress($data, 3, ZSTD_COMPRESS_COMPACT)));
+
+echo "Streams\n";
+
+$ctx = stream_context_create(array("zstd" => array("checksum" => true)));
+var_dump(file_put_contents('compress.zstd://' . $file, $data, 0, $ctx) == strlen($data));
+var_dump(zstd_frame_checksum(file_get_contents($file)) === $hash);
+var_dump(file_get_contents('compress.zstd://' . $file) === $data);
+
+echo "Files\n";
+
+$source = $file . '.src';
+file_put_contents($source, $data);
+var_dump(zstd_compress_file($source, $file, array('checksum' => true)) > 0);
+var_dump(zstd_frame_checksum(file_get_contents($file)) === $hash);
+
+echo "Errors\n";
+
+var_dump(zstd_frame_checksum('foo'));
+
+@unlink($file);
+@unlink($source);
+?>
+===Done===
+--EXPECTF--
+Compression
+bool(true)
+bool(true)
+bool(true)
+NULL
+bool(true)
+bool(false)
+Compact
+bool(true)
+bool(true)
+NULL
+Streams
+bool(true)
+bool(true)
+bool(true)
+Files
+bool(true)
+bool(true)
+Errors
+
+Warning: zstd_frame_checksum(): it was not compressed by zstd in %s on line %d
+bool(false)
+===Done===
@@ -0,0 +1,61 @@
+--TEST--
+zstd_get_frame_info(): frame inspection
+--SKIPIF--
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+$dictionary = file_get_contents(dirname(__FILE__) . '/data.dic');
+
+echo "*** Single frame ***", PHP_EOL;
+$compressed = zstd_compress($data);
+$info = zstd_get_frame_info($compressed);
+var_dump($info['frames']);
+var_dump($info['skippable_frames']);
+var_dump($info['content_size'] === strlen($data));
+var_dump($info['window_size'] > 0);
+var_dump($info['dict_id']);
+var_dump($info['checksum']);
+var_dump($info['frame_sizes'] === [strlen($compressed)]);
+
+echo "*** Multiple frames ***", PHP_EOL;
+$second = zstd_compress('second frame');
+$skippable = pack('VV', 0x184D2A50, 3) . 'abc';
+$info = zstd_get_frame_info($compressed . $skippable . $second);
+var_dump($info['frames']);
+var_dump($info['skippable_frames']);
+var_dump($info['content_size'] === strlen($data) + strlen('second frame'));
+var_dump($info['frame_sizes'] === [strlen($compressed), 11, strlen($second)]);
+
+echo "*** Dictionary ***", PHP_EOL;
+$info = zstd_get_frame_info(zstd_compress_dict($data, $dictionary));
+var_dump($info['dict_id'] > 0);
+
+echo "*** Invalid ***", PHP_EOL;
+var_dump(zstd_get_frame_info('message string'));
+var_dump(zstd_get_frame_info(substr($compressed, 0, -1)));
+?>
+===Done===
+--EXPECTF--
+*** Single frame ***
+int(1)
+int(0)
+bool(true)
+bool(true)
+int(0)
+bool(false)
+bool(true)
+*** Multiple frames ***
+int(2)
+int(1)
+bool(true)
+bool(true)
+*** Dictionary ***
+bool(true)
+*** Invalid ***
+
+Warning: zstd_get_frame_info(): it was not compressed by zstd in %s on line %d
+bool(false)
+
+Warning: zstd_get_frame_info(): %s in %s on line %d
+bool(false)
+===Done===
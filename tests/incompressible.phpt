@@ -0,0 +1,80 @@
+--TEST--
+zstd_compress(): incompressible data detection
+--SKIPIF--
+<?php
+if (LIBZSTD_VERSION_NUMBER < 10400) die("skip needs libzstd 1.4.0");
+?>
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+
+$file = dirname(__FILE__) . '/data_' . basename(__FILE__, ".php") . '.out';
+
+$random = random_bytes(300000);
+$text = str_repeat($data, 4);
+
+echo "Compression\n";
+
+$stats = zstd_stats();
+$stored = zstd_compress($random, 3, ZSTD_COMPRESS_DETECT_INCOMPRESSIBLE);
+var_dump(strlen($stored) <= strlen($random) + 32);
+var_dump(zstd_uncompress($stored) === $random);
+$info = zstd_get_frame_info($stored);
+var_dump($info['content_size'] === strlen($random));
+
+$compressed = zstd_compress($text, 3, ZSTD_COMPRESS_DETECT_INCOMPRESSIBLE);
+var_dump($compressed === zstd_compress($text));
+var_dump(zstd_uncompress($compressed) === $text);
+
+$after = zstd_stats();
+var_dump($after['compress_calls'] - $stats['compress_calls']);
+var_dump($after['incompressible'] - $stats['incompressible']);
+var_dump($after['incompressible_bytes'] - $stats['incompressible_bytes']);
+var_dump($after['bytes_in'] - $stats['bytes_in'] >= strlen($random) + strlen($text));
+
+echo "Compact\n";
+
+$stored = zstd_compress($random, 3,
+  ZSTD_COMPRESS_COMPACT | ZSTD_COMPRESS_DETECT_INCOMPRESSIBLE);
+var_dump(strlen($stored) <= strlen($random) + 32);
+var_dump(zstd_uncompress($stored) === $random);
+
+echo "Streams\n";
+
+$ctx = stream_context_create(array("zstd" => array("detect" => true)));
+$fp = fopen('compress.zstd://' . $file, 'w', false, $ctx);
+fwrite($fp, $text);
+fwrite($fp, $random);
+fwrite($fp, $text);
+fclose($fp);
+var_dump(filesize($file) < strlen($random) + strlen($text));
+var_dump(file_get_contents('compress.zstd://' . $file) === $text . $random . $text);
+
+$ctx = stream_context_create(
+  array("zstd" => array("detect" => true, "size" => strlen($random))));
+var_dump(file_put_contents('compress.zstd://' . $file, $random, 0, $ctx) == strlen($random));
+
+@unlink($file);
+?>
+===Done===
+--EXPECTF--
+Compression
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+int(3)
+int(1)
+int(300000)
+bool(true)
+Compact
+bool(true)
+bool(true)
+Streams
+bool(true)
+bool(true)
+
+Warning: file_put_contents(): zstd: detect can not be used with a pledged size in %s on line %d
+bool(true)
+===Done===
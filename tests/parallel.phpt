@@ -0,0 +1,64 @@
+--TEST--
+zstd_uncompress_parallel(): multiple frames
+--SKIPIF--
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+
+echo "*** Multiple frames ***", PHP_EOL;
+$input = '';
+$compressed = '';
+for ($i = 0; $i < 8; $i++) {
+  $chunk = str_repeat($data, $i + 1) . $i;
+  $input .= $chunk;
+  $compressed .= zstd_compress($chunk);
+}
+var_dump(zstd_uncompress_parallel($compressed) === $input);
+var_dump(zstd_uncompress_parallel($compressed, 1) === $input);
+var_dump(zstd_uncompress_parallel($compressed, 3) === $input);
+var_dump(\Zstd\uncompress_parallel($compressed, 16) === $input);
+
+echo "*** Many frames ***", PHP_EOL;
+$input = '';
+$compressed = '';
+for ($i = 0; $i < 2000; $i++) {
+  $input .= $i;
+  $compressed .= zstd_compress((string) $i);
+}
+var_dump(zstd_uncompress_parallel($compressed, PHP_INT_MAX) === $input);
+
+echo "*** Single frame ***", PHP_EOL;
+var_dump(zstd_uncompress_parallel(zstd_compress($data)) === $data);
+
+echo "*** Unknown content size ***", PHP_EOL;
+$file = dirname(__FILE__) . '/data_' . basename(__FILE__, ".php") . '.out';
+file_put_contents('compress.zstd://' . $file, $data);
+file_put_contents('compress.zstd://' . $file, $data, FILE_APPEND);
+var_dump(zstd_uncompress_parallel(file_get_contents($file)) === $data . $data);
+@unlink($file);
+
+echo "*** Invalid ***", PHP_EOL;
+var_dump(zstd_uncompress_parallel('message string'));
+var_dump(zstd_uncompress_parallel($compressed, -1));
+?>
+===Done===
+--EXPECTF--
+*** Multiple frames ***
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+*** Many frames ***
+bool(true)
+*** Single frame ***
+bool(true)
+*** Unknown content size ***
+bool(true)
+*** Invalid ***
+
+Warning: zstd_uncompress_parallel(): it was not compressed by zstd in %s on line %d
+bool(false)
+
+Warning: zstd_uncompress_parallel(): workers (-1) must be 0 or greater in %s on line %d
+bool(false)
+===Done===
@@ -0,0 +1,87 @@
+--TEST--
+zstd_serialize()/zstd_unserialize(): compressed serialization
+--SKIPIF--
+<?php
+if (LIBZSTD_VERSION_NUMBER < 10400) die("skip needs libzstd 1.4.0");
+if (PHP_VERSION_ID < 80000) die("skip needs PHP 8.0");
+?>
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+$dictionary = file_get_contents(dirname(__FILE__) . '/data.dic');
+
+class Node {
+  public $name;
+  public $children = array();
+  public function __construct($name) { $this->name = $name; }
+}
+
+class Wrapper {
+  public $value;
+  public function __serialize(): array {
+    return array(zstd_serialize($this->value));
+  }
+  public function __unserialize(array $data): void {
+    $this->value = zstd_unserialize($data[0]);
+  }
+}
+
+$root = new Node('root');
+for ($i = 0; $i < 100; $i++) {
+  $root->children[] = new Node("child $i");
+}
+$value = array('data' => $data, 'int' => 10, 'root' => $root);
+
+echo "*** Serialize ***", PHP_EOL;
+$compressed = zstd_serialize($value);
+var_dump(strlen($compressed) < strlen(serialize($value)));
+var_dump(zstd_unserialize($compressed) == $value);
+var_dump(zstd_uncompress($compressed) === serialize($value));
+var_dump(\Zstd\unserialize(\Zstd\serialize($value, 19)) == $value);
+
+echo "*** Scalars ***", PHP_EOL;
+var_dump(zstd_unserialize(zstd_serialize(null)));
+var_dump(zstd_unserialize(zstd_serialize(false)));
+var_dump(zstd_unserialize(zstd_serialize('')));
+
+echo "*** Dictionary ***", PHP_EOL;
+zstd_dict_register($dictionary);
+var_dump(zstd_unserialize(zstd_serialize($value, 3, $dictionary)) == $value);
+
+echo "*** Nested ***", PHP_EOL;
+$wrapper = new Wrapper;
+$wrapper->value = $value;
+var_dump(zstd_unserialize(zstd_serialize(array($wrapper, $value)))[0]->value == $value);
+
+echo "*** Options ***", PHP_EOL;
+var_dump(get_class(zstd_unserialize($compressed, array('allowed_classes' => false))['root']));
+
+echo "*** Invalid ***", PHP_EOL;
+var_dump(zstd_unserialize('message string'));
+var_dump(zstd_unserialize(zstd_compress('message string')));
+?>
+===Done===
+--EXPECTF--
+*** Serialize ***
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+*** Scalars ***
+NULL
+bool(false)
+string(0) ""
+*** Dictionary ***
+bool(true)
+*** Nested ***
+bool(true)
+*** Options ***
+string(22) "__PHP_Incomplete_Class"
+*** Invalid ***
+
+Warning: zstd_unserialize(): it was not compressed by zstd in %s on line %d
+bool(false)
+
+%s: zstd_unserialize(): Error at offset 0 of 14 bytes in %s on line %d
+bool(false)
+===Done===
@@ -0,0 +1,80 @@
+--TEST--
+compress.zstd streams with pledged size
+--SKIPIF--
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+
+$file = dirname(__FILE__) . '/data_' . basename(__FILE__, ".php") . '.out';
+
+echo "Compression\n";
+
+$ctx = stream_context_create(
+	array(
+		"zstd" => array(
+			"size" => strlen($data),
+		)
+	)
+);
+
+var_dump(file_put_contents('compress.zstd://' . $file, $data, 0, $ctx) == strlen($data));
+$info = zstd_get_frame_info(file_get_contents($file));
+var_dump($info['content_size'] === strlen($data));
+
+echo "Decompression\n";
+
+var_dump(zstd_uncompress(file_get_contents($file)) === $data);
+var_dump(file_get_contents('compress.zstd://' . $file) === $data);
+
+echo "Append\n";
+
+var_dump(file_put_contents('compress.zstd://' . $file, $data, FILE_APPEND, $ctx) == strlen($data));
+var_dump(zstd_uncompress(file_get_contents($file)) === $data . $data);
+
+echo "Empty\n";
+
+$ctx = stream_context_create(
+	array(
+		"zstd" => array(
+			"size" => 0,
+		)
+	)
+);
+
+var_dump(file_put_contents('compress.zstd://' . $file, '', 0, $ctx));
+$info = zstd_get_frame_info(file_get_contents($file));
+var_dump($info['content_size']);
+var_dump(file_get_contents('compress.zstd://' . $file));
+
+echo "Wrong size\n";
+
+$ctx = stream_context_create(
+	array(
+		"zstd" => array(
+			"size" => strlen($data) + 1,
+		)
+	)
+);
+file_put_contents('compress.zstd://' . $file, $data, 0, $ctx);
+
+@unlink($file);
+?>
+===Done===
+--EXPECTF--
+Compression
+bool(true)
+bool(true)
+Decompression
+bool(true)
+bool(true)
+Append
+bool(true)
+bool(true)
+Empty
+int(0)
+int(0)
+string(0) ""
+Wrong size
+
+Warning: file_put_contents(): libzstd error %s
+%A===Done===
@@ -0,0 +1,135 @@
+--TEST--
+compress.zstd streams with adaptive level
+--SKIPIF--
+<?php
+if (LIBZSTD_VERSION_NUMBER < 10400) die("skip needs libzstd 1.4.0");
+?>
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+
+$file = dirname(__FILE__) . '/data_' . basename(__FILE__, ".php") . '.out';
+
+echo "Compression\n";
+
+$ctx = stream_context_create(
+	array(
+		"zstd" => array(
+			"adapt" => true,
+			"min_level" => 1,
+			"max_level" => 6,
+		)
+	)
+);
+
+$fp = fopen('compress.zstd://' . $file, 'w', false, $ctx);
+for ($i = 0; $i < 2000; $i++) {
+	fwrite($fp, $data . $i);
+}
+fclose($fp);
+$info = zstd_get_frame_info(file_get_contents($file));
+var_dump($info['frames'] >= 1);
+
+echo "Decompression\n";
+
+$expected = '';
+for ($i = 0; $i < 2000; $i++) {
+	$expected .= $data . $i;
+}
+var_dump(file_get_contents('compress.zstd://' . $file) === $expected);
+var_dump(zstd_uncompress(file_get_contents($file)) === $expected);
+
+echo "Slow stream\n";
+
+class SlowStream {
+	public $context;
+	public static $data = '';
+
+	function stream_open($path, $mode, $options, &$opened_path) {
+		self::$data = '';
+		return true;
+	}
+	function stream_write($data) {
+		usleep(20000);
+		self::$data .= $data;
+		return strlen($data);
+	}
+	function stream_close() {
+	}
+}
+stream_wrapper_register('slow', 'SlowStream');
+
+// Writing likely dominates and raises the level, but timing decides
+// when: only check that a frame ends at most once per MB of input
+$fp = fopen('compress.zstd://slow://out', 'w', false, $ctx);
+for ($i = 0; $i < 2000; $i++) {
+	fwrite($fp, $data . $i);
+}
+fclose($fp);
+$info = zstd_get_frame_info(SlowStream::$data);
+$pos = 0;
+$sizes = array();
+foreach ($info['frame_sizes'] as $size) {
+	$sizes[] = strlen(zstd_uncompress(substr(SlowStream::$data, $pos, $size)));
+	$pos += $size;
+}
+array_pop($sizes);
+var_dump(count($sizes) === 0 || min($sizes) >= 1024 * 1024);
+var_dump(zstd_uncompress(SlowStream::$data) === $expected);
+
+// Without adaptation the frame is never ended early
+$ctx = stream_context_create(array("zstd" => array("level" => 3)));
+$fp = fopen('compress.zstd://slow://out', 'w', false, $ctx);
+for ($i = 0; $i < 2000; $i++) {
+	fwrite($fp, $data . $i);
+}
+fclose($fp);
+$info = zstd_get_frame_info(SlowStream::$data);
+var_dump($info['frames']);
+
+echo "Dictionary\n";
+
+$ctx = stream_context_create(
+	array(
+		"zstd" => array(
+			"adapt" => true,
+			"dict" => file_get_contents(dirname(__FILE__) . '/data.dic'),
+		)
+	)
+);
+var_dump(file_put_contents('compress.zstd://' . $file, $data, 0, $ctx) == strlen($data));
+
+echo "Pledged size\n";
+
+$ctx = stream_context_create(
+	array(
+		"zstd" => array(
+			"adapt" => true,
+			"size" => strlen($data),
+		)
+	)
+);
+var_dump(file_put_contents('compress.zstd://' . $file, $data, 0, $ctx) == strlen($data));
+
+@unlink($file);
+?>
+===Done===
+--EXPECTF--
+Compression
+bool(true)
+Decompression
+bool(true)
+bool(true)
+Slow stream
+bool(true)
+bool(true)
+int(1)
+Dictionary
+
+Warning: file_put_contents(): zstd: adapt can not be used with dict in %s on line %d
+bool(true)
+Pledged size
+
+Warning: file_put_contents(): zstd: adapt can not be used with a pledged size in %s on line %d
+bool(true)
+===Done===
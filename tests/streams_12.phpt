@@ -0,0 +1,60 @@
+--TEST--
+compress.zstd streams reading mapped and buffered files
+--INI--
+allow_url_fopen=1
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+
+$file = dirname(__FILE__) . '/data_' . basename(__FILE__, ".php") . '.out';
+
+$expected = '';
+$compressed = '';
+for ($i = 0; $i < 300; $i++) {
+  $expected .= $data . $i;
+  $compressed .= zstd_compress($data . $i);
+}
+file_put_contents($file, $compressed);
+
+echo "Local file\n";
+
+var_dump(file_get_contents('compress.zstd://' . $file) === $expected);
+
+$fp = fopen('compress.zstd://' . $file, 'r');
+$read = '';
+while (!feof($fp)) {
+  $read .= fread($fp, 1000);
+}
+fclose($fp);
+var_dump($read === $expected);
+
+echo "Large frame\n";
+
+$large = str_repeat($data, 3000);
+file_put_contents($file, zstd_compress($large));
+var_dump(file_get_contents('compress.zstd://' . $file) === $large);
+
+echo "Empty file\n";
+
+file_put_contents($file, '');
+var_dump(file_get_contents('compress.zstd://' . $file));
+
+echo "Other stream\n";
+
+$url = 'data://application/octet-stream;base64,' . base64_encode($compressed);
+var_dump(file_get_contents('compress.zstd://' . $url) === $expected);
+
+@unlink($file);
+?>
+===Done===
+--EXPECT--
+Local file
+bool(true)
+bool(true)
+Large frame
+bool(true)
+Empty file
+string(0) ""
+Other stream
+bool(true)
+===Done===
@@ -0,0 +1,72 @@
+--TEST--
+zstd_uncompress_chunks(): chunked decompression
+--FILE--
+<?php
+include(dirname(__FILE__) . '/data.inc');
+
+$compressed = zstd_compress($data);
+
+echo "*** Chunks ***", PHP_EOL;
+$chunks = zstd_uncompress_chunks($compressed, 1000);
+var_dump($chunks instanceof Traversable);
+foreach ($chunks as $i => $chunk) {
+  echo $i, ': ', strlen($chunk), PHP_EOL;
+}
+var_dump(implode('', iterator_to_array($chunks)) === $data);
+
+echo "*** Multiple frames ***", PHP_EOL;
+$output = '';
+foreach (\Zstd\uncompress_chunks($compressed . zstd_compress($data, 19), 4096) as $chunk) {
+  $output .= $chunk;
+}
+var_dump($output === $data . $data);
+
+echo "*** Empty ***", PHP_EOL;
+var_dump(iterator_to_array(zstd_uncompress_chunks(zstd_compress(''), 10)));
+
+echo "*** Truncated ***", PHP_EOL;
+foreach (zstd_uncompress_chunks(substr($compressed, 0, -10), 100000) as $chunk) {
+  echo strlen($chunk), PHP_EOL;
+}
+
+echo "*** Invalid ***", PHP_EOL;
+var_dump(zstd_uncompress_chunks('message string', 10));
+var_dump(zstd_uncompress_chunks($compressed, 0));
+
+echo "*** Constructor ***", PHP_EOL;
+$method = new ReflectionMethod('Zstd\UncompressChunks', '__construct');
+var_dump($method->isPrivate());
+try {
+  new Zstd\UncompressChunks();
+} catch (Error $e) {
+  echo $e->getMessage(), PHP_EOL;
+}
+?>
+===Done===
+--EXPECTF--
+*** Chunks ***
+bool(true)
+0: 1000
+1: 1000
+2: 1000
+3: 547
+bool(true)
+*** Multiple frames ***
+bool(true)
+*** Empty ***
+array(0) {
+}
+*** Truncated ***
+
+Warning: %s: can not decompress stream in %s on line %d
+*** Invalid ***
+
+Warning: zstd_uncompress_chunks(): it was not compressed by zstd in %s on line %d
+bool(false)
+
+Warning: zstd_uncompress_chunks(): chunk size (0) must be greater than 0 in %s on line %d
+bool(false)
+*** Constructor ***
+bool(true)
+Call to private Zstd\UncompressChunks::__construct() from %s
+===Done===
@@ -28,11 +28,13 @@
 #include <php.h>
 #include <php_ini.h>
 #include <ext/standard/info.h>
+#include <math.h>
 #include <ext/standard/php_smart_string.h>
-#if defined(HAVE_APCU_SUPPORT)
 #include <ext/standard/php_var.h>
-#include <ext/apcu/apc_serializer.h>
+#include <zend_interfaces.h>
 #include <zend_smart_str.h>
+#if defined(HAVE_APCU_SUPPORT)
+#include <ext/apcu/apc_serializer.h>
 #endif
 #include "php_zstd.h"
 
@@ -43,7 +45,23 @@
 #ifdef HAVE_STDINT_H
 #include <stdint.h>
 #endif
+#ifdef PHP_WIN32
+#include "win32/time.h"
+#else
+#include <sys/time.h>
+#include <time.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+/* The experimental API is only stable within a libzstd release, a system
+ * library must be the one the extension was built against (see MINIT) */
+#define ZSTD_STATIC_LINKING_ONLY
 #include "zstd.h"
+#include "zstd_errors.h"
+#if defined(HAVE_ZSTD_THREADS)
+#include <pthread.h>
+#endif
 
 #ifndef ZSTD_CLEVEL_DEFAULT
 #define ZSTD_CLEVEL_DEFAULT 3
@@ -51,30 +69,66 @@
 
 #define DEFAULT_COMPRESS_LEVEL 3
 
+#define PHP_ZSTD_COMPRESS_COMPACT (1 << 0)
+#define PHP_ZSTD_COMPRESS_DETECT_INCOMPRESSIBLE (1 << 1)
+#define PHP_ZSTD_COMPRESS_CHECKSUM (1 << 2)
+
 // zend_string_efree doesnt exist in PHP7.2, 20180731 is PHP 7.3
 #if ZEND_MODULE_API_NO < 20180731
 #define zend_string_efree(string) zend_string_free(string)
 #endif
 
+#ifndef ZSTR_MAX_LEN
+#define ZSTR_MAX_LEN (SIZE_MAX - 32)
+#endif
+
 #define ZSTD_WARNING(...) \
     php_error_docref(NULL, E_WARNING, __VA_ARGS__)
 
 #define ZSTD_IS_ERROR(result) \
     UNEXPECTED(ZSTD_isError(result))
 
+ZEND_DECLARE_MODULE_GLOBALS(zstd)
+
+PHP_INI_BEGIN()
+    STD_PHP_INI_ENTRY("zstd.dictionaries", "", PHP_INI_SYSTEM,
+                      OnUpdateString, dictionaries,
+                      zend_zstd_globals, zstd_globals)
+    STD_PHP_INI_ENTRY("zstd.cache_size", "0", PHP_INI_SYSTEM,
+                      OnUpdateLong, cache_size,
+                      zend_zstd_globals, zstd_globals)
+#if defined(HAVE_APCU_SUPPORT)
+    STD_PHP_INI_ENTRY("zstd.apcu_dictionary", "", PHP_INI_SYSTEM,
+                      OnUpdateString, apcu_dictionary,
+                      zend_zstd_globals, zstd_globals)
+#endif
+PHP_INI_END()
+
 ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_compress, 0, 0, 1)
     ZEND_ARG_INFO(0, data)
     ZEND_ARG_INFO(0, level)
+    ZEND_ARG_INFO(0, flags)
 ZEND_END_ARG_INFO()
 
 ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_uncompress, 0, 0, 1)
     ZEND_ARG_INFO(0, data)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_uncompress_parallel, 0, 0, 1)
+    ZEND_ARG_INFO(0, data)
+    ZEND_ARG_INFO(0, workers)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_uncompress_chunks, 0, 0, 2)
+    ZEND_ARG_INFO(0, data)
+    ZEND_ARG_INFO(0, chunkSize)
+ZEND_END_ARG_INFO()
+
 ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_compress_dict, 0, 0, 2)
     ZEND_ARG_INFO(0, data)
     ZEND_ARG_INFO(0, dictBuffer)
     ZEND_ARG_INFO(0, level)
+    ZEND_ARG_INFO(0, flags)
 ZEND_END_ARG_INFO()
 
 ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_uncompress_dict, 0, 0, 2)
@@ -82,6 +136,108 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_uncompress_dict, 0, 0, 2)
     ZEND_ARG_INFO(0, dictBuffer)
 ZEND_END_ARG_INFO()
 
+#if ZSTD_VERSION_NUMBER >= 10400
+ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_compress_delta, 0, 0, 2)
+    ZEND_ARG_INFO(0, data)
+    ZEND_ARG_INFO(0, base)
+    ZEND_ARG_INFO(0, level)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_uncompress_delta, 0, 0, 2)
+    ZEND_ARG_INFO(0, data)
+    ZEND_ARG_INFO(0, base)
+ZEND_END_ARG_INFO()
+#endif
+
+#if ZSTD_VERSION_NUMBER >= 10400
+ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_compress_file, 0, 0, 2)
+    ZEND_ARG_INFO(0, source)
+    ZEND_ARG_INFO(0, dest)
+    ZEND_ARG_INFO(0, options)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_uncompress_file, 0, 0, 2)
+    ZEND_ARG_INFO(0, source)
+    ZEND_ARG_INFO(0, dest)
+    ZEND_ARG_INFO(0, options)
+ZEND_END_ARG_INFO()
+#endif
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_get_frame_info, 0, 0, 1)
+    ZEND_ARG_INFO(0, data)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_frame_checksum, 0, 0, 1)
+    ZEND_ARG_INFO(0, data)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_compressed___construct, 0, 0, 1)
+    ZEND_ARG_INFO(0, data)
+    ZEND_ARG_INFO(0, cache)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_compressed_compress, 0, 0, 1)
+    ZEND_ARG_INFO(0, data)
+    ZEND_ARG_INFO(0, level)
+    ZEND_ARG_INFO(0, flags)
+    ZEND_ARG_INFO(0, cache)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_compressed_void, 0, 0, 0)
+ZEND_END_ARG_INFO()
+
+#define arginfo_zstd_chunks___construct arginfo_zstd_compressed_void
+
+#if PHP_VERSION_ID >= 80000
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_zstd_compressed___tostring,
+                                        0, 0, IS_STRING, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_zstd_compressed___serialize,
+                                        0, 0, IS_ARRAY, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_zstd_compressed___unserialize,
+                                        0, 1, IS_VOID, 0)
+    ZEND_ARG_TYPE_INFO(0, data, IS_ARRAY, 0)
+ZEND_END_ARG_INFO()
+#else
+#define arginfo_zstd_compressed___tostring arginfo_zstd_compressed_void
+#define arginfo_zstd_compressed___serialize arginfo_zstd_compressed_void
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_compressed___unserialize, 0, 0, 1)
+    ZEND_ARG_INFO(0, data)
+ZEND_END_ARG_INFO()
+#endif
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_dict_register, 0, 0, 1)
+    ZEND_ARG_INFO(0, dict)
+ZEND_END_ARG_INFO()
+
+#if ZSTD_VERSION_NUMBER >= 10400
+ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_serialize, 0, 0, 1)
+    ZEND_ARG_INFO(0, value)
+    ZEND_ARG_INFO(0, level)
+    ZEND_ARG_INFO(0, dict)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_unserialize, 0, 0, 1)
+    ZEND_ARG_INFO(0, data)
+    ZEND_ARG_INFO(0, options)
+ZEND_END_ARG_INFO()
+#endif
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_stats, 0, 0, 0)
+ZEND_END_ARG_INFO()
+
+#if ZSTD_VERSION_NUMBER >= 10400
+ZEND_BEGIN_ARG_INFO_EX(arginfo_zstd_bench, 0, 0, 1)
+    ZEND_ARG_INFO(0, samples)
+    ZEND_ARG_INFO(0, levels)
+    ZEND_ARG_INFO(0, options)
+ZEND_END_ARG_INFO()
+#endif
+
 static size_t zstd_check_compress_level(zend_long level)
 {
     uint16_t maxLevel = (uint16_t) ZSTD_maxCLevel();
@@ -117,418 +273,2986 @@ static zend_always_inline zend_string* zstd_string_output_truncate(zend_string*
     return output;
 }
 
-ZEND_FUNCTION(zstd_compress)
-{
-    zend_string *output;
-    size_t size, result;
-    zend_long level = DEFAULT_COMPRESS_LEVEL;
+/* Largest buffer kept between calls, larger outputs are allocated
+ * directly */
+#define ZSTD_SCRATCH_MAX (1024 * 1024)
 
-    char *input;
-    size_t input_len;
+/* Buffer reused by the calls of a request, NULL when size is too large
+ * or when it is in use by an outer call: the caller allocates its own */
+static char *php_zstd_scratch_acquire(size_t size)
+{
+    size_t grow;
 
-#if PHP_VERSION_ID < 80000
-    zval *data;
-    if (zend_parse_parameters(ZEND_NUM_ARGS(),
-                              "z|l", &data, &level) == FAILURE) {
-      RETURN_FALSE;
+    if (PHP_ZSTD_G(scratch_busy) || size > ZSTD_SCRATCH_MAX) {
+        return NULL;
     }
-    if (Z_TYPE_P(data) != IS_STRING) {
-      zend_error(E_WARNING, "zstd_compress(): expects parameter to be string.");
-      RETURN_FALSE;
+    if (PHP_ZSTD_G(scratch_size) < size) {
+        grow = MIN(MAX(size, PHP_ZSTD_G(scratch_size) * 2), ZSTD_SCRATCH_MAX);
+        PHP_ZSTD_G(scratch) = erealloc(PHP_ZSTD_G(scratch), grow);
+        PHP_ZSTD_G(scratch_size) = grow;
     }
-    input = Z_STRVAL_P(data);
-    input_len = Z_STRLEN_P(data);
-#else
-    ZEND_PARSE_PARAMETERS_START(1, 2)
-        Z_PARAM_STRING(input, input_len)
-        Z_PARAM_OPTIONAL
-        Z_PARAM_LONG(level)
-    ZEND_PARSE_PARAMETERS_END();
-#endif
+    PHP_ZSTD_G(scratch_busy) = 1;
+    return PHP_ZSTD_G(scratch);
+}
 
-    if (!zstd_check_compress_level(level)) {
-        RETURN_FALSE;
-    }
+static zend_always_inline void php_zstd_scratch_release(void)
+{
+    PHP_ZSTD_G(scratch_busy) = 0;
+}
 
-    size = ZSTD_compressBound(input_len);
-    output = zend_string_alloc(size, 0);
+/* Output buffer of size bytes: the scratch buffer when possible */
+static zend_always_inline char *php_zstd_output_alloc(zend_string **output,
+                                                      size_t size)
+{
+    char *scratch = php_zstd_scratch_acquire(size);
 
-    result = ZSTD_compress(ZSTR_VAL(output), size, input, input_len,
-                           (int)level);
+    if (scratch) {
+        *output = NULL;
+        return scratch;
+    }
+    *output = zend_string_alloc(size, 0);
+    return ZSTR_VAL(*output);
+}
 
-    if (ZSTD_IS_ERROR(result)) {
-        zend_string_efree(output);
-        RETVAL_FALSE;
+/* Exact size string of the length bytes written to the buffer returned
+ * by php_zstd_output_alloc(), copied out of the scratch buffer or
+ * shrunk in place */
+static zend_string *php_zstd_output_exact(zend_string *output,
+                                          const char *buf, size_t length)
+{
+    if (output == NULL) {
+        output = zend_string_init(buf, length, 0);
+        php_zstd_scratch_release();
+        return output;
     }
+    if (length < ZSTR_LEN(output)) {
+        output = zend_string_truncate(output, length, 0);
+    }
+    ZSTR_VAL(output)[length] = '\0';
+    return output;
+}
 
-    output = zstd_string_output_truncate(output, result);
-    RETVAL_NEW_STR(output);
+static void php_zstd_output_free(zend_string *output)
+{
+    if (output == NULL) {
+        php_zstd_scratch_release();
+    } else {
+        zend_string_efree(output);
+    }
 }
 
-ZEND_FUNCTION(zstd_uncompress)
+/* Dictionaries preloaded from zstd.dictionaries at startup, shared
+ * (copy-on-write after fork) by every request of the process */
+typedef struct _php_zstd_dict {
+    char *data;
+    size_t size;
+    unsigned int id;
+    ZSTD_CDict *cdict;
+    ZSTD_DDict *ddict;
+} php_zstd_dict;
+
+#define ZSTD_DICT_NAME_MAX 255
+/* Dictionaries registered by zstd_dict_register() in a process */
+#define ZSTD_DICT_REGISTER_MAX 64
+
+static HashTable php_zstd_dicts;
+
+static void php_zstd_dict_free(zval *zv)
 {
-    uint64_t size;
-    size_t result;
-    zend_string *output;
-    uint8_t streaming = 0;
+    php_zstd_dict *dict = (php_zstd_dict *) Z_PTR_P(zv);
 
-    char *input;
-    size_t input_len;
+    ZSTD_freeCDict(dict->cdict);
+    ZSTD_freeDDict(dict->ddict);
+    pefree(dict->data, 1);
+    pefree(dict, 1);
+}
 
-#if PHP_VERSION_ID < 80000
-    zval *data;
-    if (zend_parse_parameters(ZEND_NUM_ARGS(),
-                              "z", &data) == FAILURE) {
-      RETURN_FALSE;
+static void php_zstd_dict_load(const char *name, size_t name_len,
+                               const char *path)
+{
+    php_zstd_dict *dict;
+    FILE *fp;
+    long size;
+
+    fp = VCWD_FOPEN(path, "rb");
+    if (fp == NULL) {
+        zend_error(E_WARNING, "zstd: can not open dictionary %s", path);
+        return;
     }
-    if (Z_TYPE_P(data) != IS_STRING) {
-      zend_error(E_WARNING,
-                 "zstd_uncompress(): expects parameter to be string.");
-      RETURN_FALSE;
+    if (fseek(fp, 0, SEEK_END) != 0
+        || (size = ftell(fp)) <= 0
+        || fseek(fp, 0, SEEK_SET) != 0) {
+        fclose(fp);
+        zend_error(E_WARNING, "zstd: can not read dictionary %s", path);
+        return;
     }
-    input = Z_STRVAL_P(data);
-    input_len = Z_STRLEN_P(data);
-#else
-    ZEND_PARSE_PARAMETERS_START(1, 1)
-        Z_PARAM_STRING(input, input_len)
-    ZEND_PARSE_PARAMETERS_END();
-#endif
 
-    size = ZSTD_getFrameContentSize(input, input_len);
-    if (size == ZSTD_CONTENTSIZE_ERROR) {
-        ZSTD_WARNING("it was not compressed by zstd");
-        RETURN_FALSE;
-    } else if (size == ZSTD_CONTENTSIZE_UNKNOWN) {
-        streaming = 1;
-        size = ZSTD_DStreamOutSize();
+    dict = pecalloc(1, sizeof(php_zstd_dict), 1);
+    dict->size = (size_t) size;
+    dict->data = pemalloc(dict->size, 1);
+    if (fread(dict->data, 1, dict->size, fp) != dict->size) {
+        fclose(fp);
+        pefree(dict->data, 1);
+        pefree(dict, 1);
+        zend_error(E_WARNING, "zstd: can not read dictionary %s", path);
+        return;
+    }
+    fclose(fp);
+
+    dict->id = ZSTD_getDictID_fromDict(dict->data, dict->size);
+    dict->cdict = ZSTD_createCDict_byReference(dict->data, dict->size,
+                                               DEFAULT_COMPRESS_LEVEL);
+    dict->ddict = ZSTD_createDDict_byReference(dict->data, dict->size);
+    if (!dict->cdict || !dict->ddict) {
+        ZSTD_freeCDict(dict->cdict);
+        ZSTD_freeDDict(dict->ddict);
+        pefree(dict->data, 1);
+        pefree(dict, 1);
+        zend_error(E_WARNING, "zstd: can not load dictionary %s", path);
+        return;
     }
 
-    output = zend_string_alloc(size, 0);
-
-    if (!streaming) {
-        result = ZSTD_decompress(ZSTR_VAL(output), size,
-                                 input, input_len);
+    zend_hash_str_update_ptr(&php_zstd_dicts, name, name_len, dict);
+}
 
-        if (ZSTD_IS_ERROR(result)) {
-            zend_string_efree(output);
-            ZSTD_WARNING("can not decompress stream");
-            RETURN_FALSE;
-        }
+static zend_always_inline void zstd_trim(const char **start, const char **end)
+{
+    while (*start < *end && isspace((unsigned char) **start)) {
+        (*start)++;
+    }
+    while (*end > *start && isspace((unsigned char) *(*end - 1))) {
+        (*end)--;
+    }
+}
 
-    } else {
-        ZSTD_DStream *stream;
-        ZSTD_inBuffer in = { NULL, 0, 0 };
-        ZSTD_outBuffer out = { NULL, 0, 0 };
+// Load "name=path,name=path" entries
+static void php_zstd_dicts_load(const char *list)
+{
+    const char *entry = list, *end, *eq, *name_end, *path;
+    char *filename;
 
-        stream = ZSTD_createDStream();
-        if (stream == NULL) {
-            zend_string_efree(output);
-            ZSTD_WARNING("can not create stream");
-            RETURN_FALSE;
+    while (*entry) {
+        end = strchr(entry, ',');
+        if (end == NULL) {
+            end = entry + strlen(entry);
         }
 
-        result = ZSTD_initDStream(stream);
-        if (ZSTD_IS_ERROR(result)) {
-            zend_string_efree(output);
-            ZSTD_freeDStream(stream);
-            ZSTD_WARNING("can not init stream");
-            RETURN_FALSE;
+        eq = memchr(entry, '=', end - entry);
+        if (eq) {
+            name_end = eq;
+            path = eq + 1;
+            zstd_trim(&entry, &name_end);
+            zstd_trim(&path, &end);
+            if (name_end > entry && end > path) {
+                filename = estrndup(path, end - path);
+                php_zstd_dict_load(entry, name_end - entry, filename);
+                efree(filename);
+            }
+        } else {
+            name_end = end;
+            zstd_trim(&entry, &name_end);
+            if (name_end > entry) {
+                zend_error(E_WARNING,
+                           "zstd: invalid zstd.dictionaries entry '%.*s'",
+                           (int) (name_end - entry), entry);
+            }
         }
 
-        in.src = input;
-        in.size = input_len;
-        in.pos = 0;
-
-        out.dst = ZSTR_VAL(output);
-        out.size = size;
-        out.pos = 0;
+        entry = *end ? end + 1 : end;
+    }
+}
 
-        while (in.pos < in.size) {
-            if (out.pos == out.size) {
-                out.size += size;
-                output = zend_string_extend(output, out.size, 0);
-                out.dst = ZSTR_VAL(output);
-            }
+static php_zstd_dict *php_zstd_dict_find(const char *name, size_t name_len)
+{
+    if (zend_hash_num_elements(&php_zstd_dicts) == 0
+        || name_len > ZSTD_DICT_NAME_MAX) {
+        return NULL;
+    }
+    return (php_zstd_dict *) zend_hash_str_find_ptr(&php_zstd_dicts,
+                                                    name, name_len);
+}
 
-            result = ZSTD_decompressStream(stream, &out, &in);
-            if (ZSTD_IS_ERROR(result)) {
-                zend_string_efree(output);
-                ZSTD_freeDStream(stream);
-                ZSTD_WARNING("can not decompress stream");
-                RETURN_FALSE;
-            }
+/* Registered or preloaded dictionary with the given dictionary ID */
+static php_zstd_dict *php_zstd_dict_find_id(unsigned int id)
+{
+    php_zstd_dict *dict;
 
-            if (result == 0) {
-                break;
-            }
+    if (id == 0) {
+        return NULL;
+    }
+    dict = zend_hash_index_find_ptr(&PHP_ZSTD_G(registered_dicts), id);
+    if (dict) {
+        return dict;
+    }
+    ZEND_HASH_FOREACH_PTR(&php_zstd_dicts, dict) {
+        if (dict->id == id) {
+            return dict;
         }
+    } ZEND_HASH_FOREACH_END();
 
-        result = out.pos;
+    return NULL;
+}
 
-        ZSTD_freeDStream(stream);
+/* Dictionary ID of the first frame using a dictionary, scanning the
+ * frames up to the end of the data or of the complete frames of a
+ * partial buffer, 0 when none does */
+static unsigned int php_zstd_frames_dict_id(const void *input,
+                                            size_t input_len)
+{
+    unsigned int id;
+    size_t pos = 0, frame_size;
+
+    while (pos < input_len) {
+        id = ZSTD_getDictID_fromFrame((const char *) input + pos,
+                                      input_len - pos);
+        if (id) {
+            return id;
+        }
+        frame_size = ZSTD_findFrameCompressedSize((const char *) input + pos,
+                                                  input_len - pos);
+        if (ZSTD_IS_ERROR(frame_size)) {
+            break;
+        }
+        pos += frame_size;
     }
 
-    output = zstd_string_output_truncate(output, result);
-    RETVAL_NEW_STR(output);
+    return 0;
 }
 
-ZEND_FUNCTION(zstd_compress_dict)
+/* Let a streaming dctx pick the registered dictionary of each frame,
+ * when a frame of the data uses a dictionary */
+static void php_zstd_dctx_ref_dicts(ZSTD_DCtx *dctx,
+                                    const void *input, size_t input_len)
 {
-    zend_long level = DEFAULT_COMPRESS_LEVEL;
-
-    zend_string *output;
-    char *input, *dict;
-    size_t input_len, dict_len;
-
-    ZEND_PARSE_PARAMETERS_START(2, 3)
-        Z_PARAM_STRING(input, input_len)
-        Z_PARAM_STRING(dict, dict_len)
-        Z_PARAM_OPTIONAL
-        Z_PARAM_LONG(level)
-    ZEND_PARSE_PARAMETERS_END();
+    php_zstd_dict *dict;
+    unsigned int id = php_zstd_frames_dict_id(input, input_len);
 
-    if (!zstd_check_compress_level(level)) {
-        RETURN_FALSE;
+    if (id == 0) {
+        return;
     }
 
-    ZSTD_CCtx* const cctx = ZSTD_createCCtx();
-    if (cctx == NULL) {
-        ZSTD_WARNING("ZSTD_createCCtx() error");
-        RETURN_FALSE;
+#if ZSTD_VERSION_NUMBER >= 10500
+    if (php_zstd_dict_find_id(id) == NULL) {
+        return;
     }
-    ZSTD_CDict* const cdict = ZSTD_createCDict(dict,
-                                               dict_len,
-                                               (int)level);
-    if (!cdict) {
-        ZSTD_freeCStream(cctx);
-        ZSTD_WARNING("ZSTD_createCDict() error");
-        RETURN_FALSE;
+    /* Only used by ZSTD_decompressStream(), one-shot decompression would
+     * keep the entropy tables of the last referenced dictionary */
+    ZSTD_DCtx_setParameter(dctx, ZSTD_d_refMultipleDDicts,
+                           ZSTD_rmd_refMultipleDDicts);
+    ZEND_HASH_FOREACH_PTR(&php_zstd_dicts, dict) {
+        if (dict->id) {
+            ZSTD_DCtx_refDDict(dctx, dict->ddict);
+        }
+    } ZEND_HASH_FOREACH_END();
+    ZEND_HASH_FOREACH_PTR(&PHP_ZSTD_G(registered_dicts), dict) {
+        ZSTD_DCtx_refDDict(dctx, dict->ddict);
+    } ZEND_HASH_FOREACH_END();
+#else
+    dict = php_zstd_dict_find_id(id);
+    if (dict) {
+        ZSTD_DCtx_refDDict(dctx, dict->ddict);
     }
+#endif
+}
 
-    size_t const cBuffSize = ZSTD_compressBound(input_len);
-    output = zend_string_alloc(cBuffSize, 0);
+/* Digested dictionary, the preloaded one when dict is its name */
+static ZSTD_CDict *php_zstd_cdict(const char *dict, size_t dict_len,
+                                  int level, int *owned)
+{
+    php_zstd_dict *named = php_zstd_dict_find(dict, dict_len);
 
-    size_t const cSize = ZSTD_compress_usingCDict(cctx, ZSTR_VAL(output), cBuffSize,
-                                                  input,
-                                                  input_len,
-                                                  cdict);
-    if (ZSTD_IS_ERROR(cSize)) {
-        ZSTD_freeCStream(cctx);
-        ZSTD_freeCDict(cdict);
-        zend_string_efree(output);
-        ZSTD_WARNING("%s", ZSTD_getErrorName(cSize));
-        RETURN_FALSE;
+    *owned = 1;
+    if (named) {
+        if (level == DEFAULT_COMPRESS_LEVEL) {
+            *owned = 0;
+            return named->cdict;
+        }
+        return ZSTD_createCDict_byReference(named->data, named->size, level);
     }
+    return ZSTD_createCDict(dict, dict_len, level);
+}
 
-    output = zstd_string_output_truncate(output, cSize);
-    RETVAL_NEW_STR(output);
+static ZSTD_DDict *php_zstd_ddict(const char *dict, size_t dict_len,
+                                  int *owned)
+{
+    php_zstd_dict *named = php_zstd_dict_find(dict, dict_len);
 
-    ZSTD_freeCCtx(cctx);
-    ZSTD_freeCDict(cdict);
+    if (named) {
+        *owned = 0;
+        return named->ddict;
+    }
+    *owned = 1;
+    return ZSTD_createDDict(dict, dict_len);
 }
 
-ZEND_FUNCTION(zstd_uncompress_dict)
-{
-    char *input, *dict;
-    size_t input_len, dict_len;
-    zend_string *output;
+/* Inputs smaller than this are always compressed */
+#define ZSTD_DETECT_MIN 4096
+#define ZSTD_DETECT_SAMPLES 16
+#define ZSTD_DETECT_SAMPLE_SIZE 1024
+/* Bits per byte above which entropy coding can not gain anything */
+#define ZSTD_DETECT_ENTROPY 7.8
 
-    ZEND_PARSE_PARAMETERS_START(2, 2)
-        Z_PARAM_STRING(input, input_len)
-        Z_PARAM_STRING(dict, dict_len)
-    ZEND_PARSE_PARAMETERS_END();
+#define ZSTD_STORED_BLOCK_MAX (128 * 1024)
 
-    unsigned long long const rSize = ZSTD_getFrameContentSize(input,
-                                                              input_len);
+/* Byte entropy of a few slices spread over the input, high for data
+ * that is already compressed or encrypted */
+static int php_zstd_incompressible(const char *input, size_t input_len)
+{
+    uint32_t counts[256] = {0};
+    const unsigned char *p;
+    size_t i, j, samples, step, total;
+    double entropy = 0, prob;
 
-    if (rSize == 0 || rSize == ZSTD_CONTENTSIZE_ERROR) {
-        ZSTD_WARNING("it was not compressed by zstd");
-        RETURN_FALSE;
+    if (input_len < ZSTD_DETECT_MIN) {
+        return 0;
     }
 
-    ZSTD_DCtx* const dctx = ZSTD_createDCtx();
-    if (dctx == NULL) {
-        ZSTD_WARNING("ZSTD_createDCtx() error");
-        RETURN_FALSE;
+    samples = MIN(ZSTD_DETECT_SAMPLES, input_len / ZSTD_DETECT_SAMPLE_SIZE);
+    step = input_len / samples;
+    total = samples * ZSTD_DETECT_SAMPLE_SIZE;
+
+    for (i = 0; i < samples; i++) {
+        p = (const unsigned char *) input + i * step;
+        for (j = 0; j < ZSTD_DETECT_SAMPLE_SIZE; j++) {
+            counts[p[j]]++;
+        }
     }
-    ZSTD_DDict* const ddict = ZSTD_createDDict(dict,
-                                               dict_len);
-    if (!ddict) {
-        ZSTD_freeDStream(dctx);
-        ZSTD_WARNING("ZSTD_createDDict() error");
-        RETURN_FALSE;
+    for (i = 0; i < 256; i++) {
+        if (counts[i]) {
+            prob = (double) counts[i] / total;
+            entropy -= prob * log2(prob);
+        }
     }
 
-    output = zend_string_alloc(rSize, 0);
+    return entropy > ZSTD_DETECT_ENTROPY;
+}
 
-    size_t const dSize = ZSTD_decompress_usingDDict(dctx, ZSTR_VAL(output), rSize,
-                                                    input,
-                                                    input_len,
-                                                    ddict);
-    if (dSize != rSize) {
-        ZSTD_freeDStream(dctx);
-        ZSTD_freeDDict(ddict);
-        zend_string_efree(output);
-        ZSTD_WARNING("%s", ZSTD_getErrorName(dSize));
-        RETURN_FALSE;
+static zend_always_inline size_t php_zstd_stored_bound(size_t len)
+{
+    /* magic, descriptor, window, content size and block headers */
+    return 4 + 2 + 8 + (len / ZSTD_STORED_BLOCK_MAX + 1) * 3 + len;
+}
+
+/* Frame made of raw blocks, written without running the compressor */
+static size_t php_zstd_stored_frame(char *dst, const char *src, size_t len,
+                                    int magic)
+{
+    unsigned char *op = (unsigned char *) dst;
+    uint64_t fcs;
+    uint32_t header;
+    size_t block, fcs_size, i;
+    int fcs_flag;
+
+    if (magic) {
+        op[0] = (unsigned char) ZSTD_MAGICNUMBER;
+        op[1] = (unsigned char) (ZSTD_MAGICNUMBER >> 8);
+        op[2] = (unsigned char) (ZSTD_MAGICNUMBER >> 16);
+        op[3] = (unsigned char) (ZSTD_MAGICNUMBER >> 24);
+        op += 4;
     }
-    ZSTD_freeDCtx(dctx);
-    ZSTD_freeDDict(ddict);
 
-    output = zstd_string_output_truncate(output, dSize);
-    RETVAL_NEW_STR(output);
+    if (len < 256) {
+        /* Single segment, the window is the content */
+        *op++ = 0x20;
+        *op++ = (unsigned char) len;
+    } else {
+        if (len <= 0xffff + 256) {
+            fcs_flag = 1;
+            fcs_size = 2;
+            fcs = len - 256;
+        } else if ((uint64_t) len <= 0xffffffffU) {
+            fcs_flag = 2;
+            fcs_size = 4;
+            fcs = len;
+        } else {
+            fcs_flag = 3;
+            fcs_size = 8;
+            fcs = len;
+        }
+        *op++ = (unsigned char) (fcs_flag << 6);
+        /* 128KB window, raw blocks never look back */
+        *op++ = (17 - 10) << 3;
+        for (i = 0; i < fcs_size; i++) {
+            *op++ = (unsigned char) (fcs >> (8 * i));
+        }
+    }
+
+    do {
+        block = MIN(len, ZSTD_STORED_BLOCK_MAX);
+        header = (uint32_t) (block << 3) | (block == len ? 1 : 0);
+        op[0] = (unsigned char) header;
+        op[1] = (unsigned char) (header >> 8);
+        op[2] = (unsigned char) (header >> 16);
+        memcpy(op + 3, src, block);
+        op += 3 + block;
+        src += block;
+        len -= block;
+    } while (len > 0);
+
+    return (char *) op - dst;
 }
 
+#if ZSTD_VERSION_NUMBER >= 10400
+/* Compact frames: one marker byte followed by a magicless frame without
+ * dictionary ID. Frames written with a dictionary carry the content
+ * checksum instead, so reading them with another dictionary fails. The
+ * marker can not start a regular, skippable or legacy frame, so both
+ * formats are told apart. */
+#define ZSTD_COMPACT_MAGIC 0x7a
 
-typedef struct _php_zstd_stream_data {
-    char *bufin, *bufout;
-    size_t sizein, sizeout;
-    ZSTD_CCtx* cctx;
-    ZSTD_DCtx* dctx;
-    ZSTD_inBuffer input;
-    ZSTD_outBuffer output;
-    php_stream *stream;
-} php_zstd_stream_data;
+#define ZSTD_ERROR_CODE(name) ((size_t) -ZSTD_error_##name)
 
+static zend_always_inline int zstd_is_compact(const char *input,
+                                              size_t input_len)
+{
+    return input_len > 0 && (unsigned char) input[0] == ZSTD_COMPACT_MAGIC;
+}
 
-#define STREAM_DATA_FROM_STREAM() \
-    php_zstd_stream_data *self = (php_zstd_stream_data *) stream->abstract
+static size_t php_zstd_compress_compact(char *dst, size_t dst_size,
+                                        const char *src, size_t src_size,
+                                        int level, ZSTD_CDict *cdict,
+                                        int checksum)
+{
+    ZSTD_CCtx *cctx;
+    size_t result;
 
-#define STREAM_NAME "compress.zstd"
+    cctx = ZSTD_createCCtx();
+    if (cctx == NULL) {
+        return ZSTD_ERROR_CODE(memory_allocation);
+    }
 
-static int php_zstd_decomp_close(php_stream *stream, int close_handle)
-{
-    STREAM_DATA_FROM_STREAM();
+    if (cdict) {
+        ZSTD_CCtx_refCDict(cctx, cdict);
+    } else {
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+    }
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_format, ZSTD_f_zstd1_magicless);
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag,
+                           checksum || cdict != NULL);
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_dictIDFlag, 0);
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_contentSizeFlag, 1);
 
-    if (!self) {
-        return EOF;
+    dst[0] = (char) ZSTD_COMPACT_MAGIC;
+    result = ZSTD_compress2(cctx, dst + 1, dst_size - 1, src, src_size);
+
+    ZSTD_freeCCtx(cctx);
+
+    if (ZSTD_isError(result)) {
+        return result;
     }
+    return result + 1;
+}
 
-    if (close_handle) {
-        if (self->stream) {
-            php_stream_close(self->stream);
-            self->stream = NULL;
-        }
+/* Frame ending with the XXH64 checksum of the content, computed by
+ * libzstd while compressing */
+static size_t php_zstd_compress_checksum(char *dst, size_t dst_size,
+                                         const char *src, size_t src_size,
+                                         int level)
+{
+    ZSTD_CCtx *cctx;
+    size_t result;
+
+    cctx = ZSTD_createCCtx();
+    if (cctx == NULL) {
+        return ZSTD_ERROR_CODE(memory_allocation);
     }
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
 
-    ZSTD_freeDCtx(self->dctx);
-    efree(self->bufin);
-    efree(self->bufout);
-    efree(self);
-    stream->abstract = NULL;
+    result = ZSTD_compress2(cctx, dst, dst_size, src, src_size);
 
-    return EOF;
+    ZSTD_freeCCtx(cctx);
+    return result;
 }
 
-#if ZSTD_VERSION_NUMBER < 10400
-static int php_zstd_comp_flush_or_end(php_zstd_stream_data *self, int end)
+/* Returns NULL when the data is not a valid compact frame */
+static zend_string *php_zstd_uncompress_compact(const char *input,
+                                                size_t input_len,
+                                                ZSTD_DDict *ddict)
 {
-    size_t res;
-    int ret = 0;
+    ZSTD_frameHeader header;
+    ZSTD_DCtx *dctx;
+    zend_string *output;
+    size_t result;
 
-    /* Compress remaining data */
-    if (self->input.size)  {
-        self->input.pos = 0;
-        do {
-            self->output.size = self->sizeout;
-            self->output.pos  = 0;
-            res = ZSTD_compressStream(self->cctx, &self->output, &self->input);
-            if (ZSTD_IS_ERROR(res)) {
-                php_error_docref(NULL, E_WARNING, "libzstd error %s\n", ZSTD_getErrorName(res));
-                ret = EOF;
-            }
-            php_stream_write(self->stream, self->bufout, self->output.pos);
-        } while (self->input.pos != self->input.size);
+    if (!zstd_is_compact(input, input_len)) {
+        return NULL;
+    }
+    input++;
+    input_len--;
+
+    if (ZSTD_getFrameHeader_advanced(&header, input, input_len,
+                                     ZSTD_f_zstd1_magicless) != 0
+        || header.frameType != ZSTD_frame
+        || header.frameContentSize == ZSTD_CONTENTSIZE_UNKNOWN
+        || header.frameContentSize > ZSTR_MAX_LEN) {
+        return NULL;
     }
 
-    /* Flush / End */
-    do {
-        self->output.size = self->sizeout;
-        self->output.pos  = 0;
+    dctx = ZSTD_createDCtx();
+    if (dctx == NULL) {
+        return NULL;
+    }
+    ZSTD_DCtx_setParameter(dctx, ZSTD_d_format, ZSTD_f_zstd1_magicless);
+    if (ddict) {
+        ZSTD_DCtx_refDDict(dctx, ddict);
+    }
 
-        if (end) {
-            res = ZSTD_endStream(self->cctx, &self->output);
-        } else {
-            res = ZSTD_flushStream(self->cctx, &self->output);
-        }
-        if (ZSTD_IS_ERROR(res)) {
-            php_error_docref(NULL, E_WARNING, "libzstd error %s\n", ZSTD_getErrorName(res));
-            ret = EOF;
-        }
-        php_stream_write(self->stream, self->bufout, self->output.pos);
-    } while (res > 0);
+    output = zend_string_alloc((size_t) header.frameContentSize, 0);
+    result = ZSTD_decompressDCtx(dctx, ZSTR_VAL(output),
+                                 (size_t) header.frameContentSize,
+                                 input, input_len);
+    ZSTD_freeDCtx(dctx);
 
-    self->input.pos = 0;
-    self->input.size = 0;
+    if (ZSTD_IS_ERROR(result) || result != header.frameContentSize) {
+        zend_string_efree(output);
+        return NULL;
+    }
 
-    return ret;
+    return zstd_string_output_truncate(output, result);
 }
+#endif
 
-#else
-static int php_zstd_comp_flush_or_end(php_zstd_stream_data *self, int end)
+static zend_string *php_zstd_compress(const char *input, size_t input_len,
+                                      int level, zend_long flags)
 {
-    size_t res;
-    int ret = 0;
+    zend_string *output;
+    char *buf;
+    size_t size, result;
+    int offset = 0, checksum = 0;
 
-    ZSTD_inBuffer in = { NULL, 0, 0 };
+#if ZSTD_VERSION_NUMBER >= 10400
+    if (flags & PHP_ZSTD_COMPRESS_COMPACT) {
+        offset = 1;
+    }
+    checksum = (flags & PHP_ZSTD_COMPRESS_CHECKSUM) != 0;
+#endif
 
-    /* Flush / End */
-    do {
-        self->output.pos  = 0;
-        res = ZSTD_compressStream2(self->cctx, &self->output, &in, end ? ZSTD_e_end : ZSTD_e_flush);
-        if (ZSTD_isError(res)) {
-            php_error_docref(NULL, E_WARNING, "libzstd error %s\n", ZSTD_getErrorName(res));
-            ret = EOF;
+    PHP_ZSTD_G(stats).compress_calls++;
+    PHP_ZSTD_G(stats).bytes_in += input_len;
+
+    /* Stored frames have no checksum */
+    if ((flags & PHP_ZSTD_COMPRESS_DETECT_INCOMPRESSIBLE) && !checksum
+        && php_zstd_incompressible(input, input_len)) {
+        output = zend_string_alloc(php_zstd_stored_bound(input_len) + offset,
+                                   0);
+#if ZSTD_VERSION_NUMBER >= 10400
+        if (offset) {
+            ZSTR_VAL(output)[0] = (char) ZSTD_COMPACT_MAGIC;
         }
-        php_stream_write(self->stream, self->output.dst, self->output.pos);
-    } while (res > 0);
+#endif
+        result = offset + php_zstd_stored_frame(ZSTR_VAL(output) + offset,
+                                                input, input_len, !offset);
+        PHP_ZSTD_G(stats).incompressible++;
+        PHP_ZSTD_G(stats).incompressible_bytes += input_len;
+        PHP_ZSTD_G(stats).bytes_out += result;
+        return zstd_string_output_truncate(output, result);
+    }
 
-    return ret;
-}
+    size = ZSTD_compressBound(input_len) + offset;
+    buf = php_zstd_output_alloc(&output, size);
+
+#if ZSTD_VERSION_NUMBER >= 10400
+    if (offset) {
+        result = php_zstd_compress_compact(buf, size,
+                                           input, input_len, level, NULL,
+                                           checksum);
+    } else if (checksum) {
+        result = php_zstd_compress_checksum(buf, size,
+                                            input, input_len, level);
+    } else
 #endif
+    result = ZSTD_compress(buf, size, input, input_len, level);
+
+    if (ZSTD_IS_ERROR(result)) {
+        php_zstd_output_free(output);
+        ZSTD_WARNING("%s", ZSTD_getErrorName(result));
+        return NULL;
+    }
 
+    PHP_ZSTD_G(stats).bytes_out += result;
 
-static int php_zstd_comp_flush(php_stream *stream)
+    return php_zstd_output_exact(output, buf, result);
+}
+
+/* Compressed results of zstd_compress and zstd_compress_dict, kept in
+ * process memory for zstd.cache_size bytes and evicted least recently used
+ * first. Entries are chained by key, the input bytes are compared on hit.
+ * Dictionaries are kept once, by content, for the entries using them */
+typedef struct _php_zstd_memo_dict {
+    zend_string *data;
+    size_t refs;
+} php_zstd_memo_dict;
+
+struct _php_zstd_memo {
+    zend_string *input;
+    zend_string *output;
+    php_zstd_memo_dict *dict;
+    zend_long level;
+    zend_long flags;
+    zend_ulong key;
+    size_t size;
+    php_zstd_memo *prev, *next;
+    php_zstd_memo *chain;
+    /* Request copy of the output, shared by the hits of a request */
+    zend_string *local;
+    php_zstd_memo *local_prev, *local_next;
+};
+
+static void php_zstd_memo_dict_free(zval *zv)
 {
-    STREAM_DATA_FROM_STREAM();
+    php_zstd_memo_dict *dict = Z_PTR_P(zv);
 
-    return php_zstd_comp_flush_or_end(self, 0);
+    zend_string_release(dict->data);
+    pefree(dict, 1);
 }
 
+static zend_ulong php_zstd_memo_key(zend_string *input, zend_long level,
+                                    zend_long flags,
+                                    php_zstd_memo_dict *dict)
+{
+    zend_ulong key = zend_string_hash_val(input);
 
-static int php_zstd_comp_close(php_stream *stream, int close_handle)
+    key = key * 33 + (zend_ulong) level;
+    key = key * 33 + (zend_ulong) flags;
+    key = key * 33 + (zend_ulong) (uintptr_t) dict;
+
+    return key;
+}
+
+static void php_zstd_memo_unlink(php_zstd_memo *entry)
 {
-    STREAM_DATA_FROM_STREAM();
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        PHP_ZSTD_G(memo_head) = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        PHP_ZSTD_G(memo_tail) = entry->prev;
+    }
+    entry->prev = entry->next = NULL;
+}
 
-    if (!self) {
-        return EOF;
+static void php_zstd_memo_link(php_zstd_memo *entry)
+{
+    entry->prev = NULL;
+    entry->next = PHP_ZSTD_G(memo_head);
+    if (entry->next) {
+        entry->next->prev = entry;
+    } else {
+        PHP_ZSTD_G(memo_tail) = entry;
     }
+    PHP_ZSTD_G(memo_head) = entry;
+}
 
-    php_zstd_comp_flush_or_end(self, 1);
+static void php_zstd_memo_local_set(php_zstd_memo *entry,
+                                    zend_string *local)
+{
+    entry->local = local;
+    entry->local_prev = NULL;
+    entry->local_next = PHP_ZSTD_G(memo_locals);
+    if (entry->local_next) {
+        entry->local_next->local_prev = entry;
+    }
+    PHP_ZSTD_G(memo_locals) = entry;
+}
 
-    if (close_handle) {
-        if (self->stream) {
-            php_stream_close(self->stream);
-            self->stream = NULL;
-        }
+static void php_zstd_memo_local_drop(php_zstd_memo *entry, int release)
+{
+    if (release) {
+        zend_string_release(entry->local);
     }
+    entry->local = NULL;
 
-    ZSTD_freeCCtx(self->cctx);
-#if ZSTD_VERSION_NUMBER >= 10400
-    efree(self->output.dst);
-#else
-    efree(self->bufin);
-    efree(self->bufout);
-#endif
-    efree(self);
-    stream->abstract = NULL;
+    if (entry->local_prev) {
+        entry->local_prev->local_next = entry->local_next;
+    } else {
+        PHP_ZSTD_G(memo_locals) = entry->local_next;
+    }
+    if (entry->local_next) {
+        entry->local_next->local_prev = entry->local_prev;
+    }
+    entry->local_prev = entry->local_next = NULL;
+}
 
-    return EOF;
+/* Request copies are released at the end of the request, or forgotten
+ * when the request memory is already gone */
+static void php_zstd_memo_locals_drop(int release)
+{
+    while (PHP_ZSTD_G(memo_locals)) {
+        php_zstd_memo_local_drop(PHP_ZSTD_G(memo_locals), release);
+    }
 }
 
+static void php_zstd_memo_free(php_zstd_memo *entry)
+{
+    zend_string_release(entry->input);
+    zend_string_release(entry->output);
+    pefree(entry, 1);
+}
 
-#if PHP_VERSION_ID < 70400
-static size_t php_zstd_decomp_read(php_stream *stream, char *buf, size_t count)
+static void php_zstd_memo_remove(php_zstd_memo *entry)
+{
+    php_zstd_memo *first, *prev;
+
+    first = zend_hash_index_find_ptr(&PHP_ZSTD_G(memo), entry->key);
+    if (first == entry) {
+        if (entry->chain) {
+            zend_hash_index_update_ptr(&PHP_ZSTD_G(memo), entry->key,
+                                       entry->chain);
+        } else {
+            zend_hash_index_del(&PHP_ZSTD_G(memo), entry->key);
+        }
+    } else {
+        for (prev = first; prev && prev->chain != entry; prev = prev->chain);
+        if (prev) {
+            prev->chain = entry->chain;
+        }
+    }
+
+    if (entry->local) {
+        php_zstd_memo_local_drop(entry, 1);
+    }
+    if (entry->dict && --entry->dict->refs == 0) {
+        PHP_ZSTD_G(memo_bytes) -= sizeof(php_zstd_memo_dict)
+            + ZSTR_LEN(entry->dict->data);
+        zend_hash_del(&PHP_ZSTD_G(memo_dicts), entry->dict->data);
+    }
+
+    php_zstd_memo_unlink(entry);
+    PHP_ZSTD_G(memo_bytes) -= entry->size;
+    PHP_ZSTD_G(memo_count)--;
+    php_zstd_memo_free(entry);
+}
+
+/* Cached result with a new reference, NULL on miss */
+static zend_string *php_zstd_memo_find(zend_string *input, zend_long level,
+                                       zend_long flags, zend_string *data)
+{
+    php_zstd_memo *entry = NULL;
+    php_zstd_memo_dict *dict = NULL;
+
+    if (PHP_ZSTD_G(cache_size) <= 0) {
+        return NULL;
+    }
+
+    if (data) {
+        dict = zend_hash_find_ptr(&PHP_ZSTD_G(memo_dicts), data);
+    }
+    if (data == NULL || dict) {
+        entry = zend_hash_index_find_ptr(&PHP_ZSTD_G(memo),
+                                         php_zstd_memo_key(input, level,
+                                                           flags, dict));
+    }
+    for (; entry; entry = entry->chain) {
+        if (entry->level == level && entry->flags == flags
+            && entry->dict == dict && zend_string_equals(entry->input, input)) {
+            if (entry != PHP_ZSTD_G(memo_head)) {
+                php_zstd_memo_unlink(entry);
+                php_zstd_memo_link(entry);
+            }
+            /* Persistent strings can not be handed to scripts */
+            if (entry->local == NULL) {
+                php_zstd_memo_local_set(entry,
+                    zend_string_init(ZSTR_VAL(entry->output),
+                                     ZSTR_LEN(entry->output), 0));
+            }
+            PHP_ZSTD_G(stats).cache_hits++;
+            return zend_string_copy(entry->local);
+        }
+    }
+
+    PHP_ZSTD_G(stats).cache_misses++;
+    return NULL;
+}
+
+static void php_zstd_memo_add(zend_string *input, zend_string *output,
+                              zend_long level, zend_long flags,
+                              zend_string *data)
+{
+    php_zstd_memo *entry;
+    php_zstd_memo_dict *dict = NULL;
+    size_t size, dict_size = 0, limit;
+
+    if (PHP_ZSTD_G(cache_size) <= 0) {
+        return;
+    }
+
+    if (data) {
+        dict = zend_hash_find_ptr(&PHP_ZSTD_G(memo_dicts), data);
+        if (dict == NULL) {
+            dict_size = sizeof(php_zstd_memo_dict) + ZSTR_LEN(data);
+        }
+    }
+
+    /* A single result may take a quarter of the cache at most */
+    limit = (size_t) PHP_ZSTD_G(cache_size);
+    size = sizeof(php_zstd_memo) + ZSTR_LEN(input) + ZSTR_LEN(output);
+    if (size + dict_size > limit / 4) {
+        return;
+    }
+
+    /* Kept by the new entry, not by the ones evicted */
+    if (dict) {
+        dict->refs++;
+    }
+    while (PHP_ZSTD_G(memo_tail)
+           && PHP_ZSTD_G(memo_bytes) + size + dict_size > limit) {
+        php_zstd_memo_remove(PHP_ZSTD_G(memo_tail));
+    }
+    if (data && dict == NULL) {
+        dict = pemalloc(sizeof(php_zstd_memo_dict), 1);
+        dict->data = zend_string_init(ZSTR_VAL(data), ZSTR_LEN(data), 1);
+        dict->refs = 1;
+        zend_hash_add_new_ptr(&PHP_ZSTD_G(memo_dicts), dict->data, dict);
+        PHP_ZSTD_G(memo_bytes) += dict_size;
+    }
+
+    entry = pecalloc(1, sizeof(php_zstd_memo), 1);
+    entry->input = zend_string_init(ZSTR_VAL(input), ZSTR_LEN(input), 1);
+    entry->output = zend_string_init(ZSTR_VAL(output), ZSTR_LEN(output), 1);
+    entry->dict = dict;
+    entry->level = level;
+    entry->flags = flags;
+    entry->key = php_zstd_memo_key(input, level, flags, dict);
+    entry->size = size;
+    entry->chain = zend_hash_index_find_ptr(&PHP_ZSTD_G(memo), entry->key);
+    zend_hash_index_update_ptr(&PHP_ZSTD_G(memo), entry->key, entry);
+
+    php_zstd_memo_link(entry);
+    php_zstd_memo_local_set(entry, zend_string_copy(output));
+    PHP_ZSTD_G(memo_bytes) += size;
+    PHP_ZSTD_G(memo_count)++;
+}
+
+ZEND_FUNCTION(zstd_compress)
+{
+    zend_string *output;
+    zend_long level = DEFAULT_COMPRESS_LEVEL;
+    zend_long flags = 0;
+
+    zend_string *input;
+
+#if PHP_VERSION_ID < 80000
+    zval *data;
+    if (zend_parse_parameters(ZEND_NUM_ARGS(),
+                              "z|ll", &data, &level, &flags) == FAILURE) {
+      RETURN_FALSE;
+    }
+    if (Z_TYPE_P(data) != IS_STRING) {
+      zend_error(E_WARNING, "zstd_compress(): expects parameter to be string.");
+      RETURN_FALSE;
+    }
+    input = Z_STR_P(data);
+#else
+    ZEND_PARSE_PARAMETERS_START(1, 3)
+        Z_PARAM_STR(input)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_LONG(level)
+        Z_PARAM_LONG(flags)
+    ZEND_PARSE_PARAMETERS_END();
+#endif
+
+    if (!zstd_check_compress_level(level)) {
+        RETURN_FALSE;
+    }
+
+    output = php_zstd_memo_find(input, level, flags, NULL);
+    if (output) {
+        RETURN_STR(output);
+    }
+
+    output = php_zstd_compress(ZSTR_VAL(input), ZSTR_LEN(input),
+                               (int) level, flags);
+    if (output == NULL) {
+        RETURN_FALSE;
+    }
+    php_zstd_memo_add(input, output, level, flags, NULL);
+
+    RETVAL_NEW_STR(output);
+}
+
+static zend_string *php_zstd_uncompress(const char *input, size_t input_len)
+{
+    uint64_t size;
+    size_t result;
+    zend_string *output;
+    uint8_t streaming = 0;
+
+#if ZSTD_VERSION_NUMBER >= 10400
+    if (zstd_is_compact(input, input_len)) {
+        output = php_zstd_uncompress_compact(input, input_len, NULL);
+        if (output == NULL) {
+            ZSTD_WARNING("can not decompress stream");
+        }
+        return output;
+    }
+#endif
+
+    size = ZSTD_findDecompressedSize(input, input_len);
+    if (size == ZSTD_CONTENTSIZE_ERROR) {
+        ZSTD_WARNING("it was not compressed by zstd");
+        return NULL;
+    } else if (size == ZSTD_CONTENTSIZE_UNKNOWN || size > ZSTR_MAX_LEN) {
+        streaming = 1;
+        size = ZSTD_DStreamOutSize();
+    } else if (php_zstd_frames_dict_id(input, input_len)) {
+        /* Registered dictionaries are picked frame by frame */
+        streaming = 1;
+    }
+
+    output = zend_string_alloc(size, 0);
+
+    if (!streaming) {
+        result = ZSTD_decompress(ZSTR_VAL(output), size,
+                                 input, input_len);
+
+        if (ZSTD_IS_ERROR(result)) {
+            zend_string_efree(output);
+            ZSTD_WARNING("can not decompress stream");
+            return NULL;
+        }
+
+    } else {
+        ZSTD_DStream *stream;
+        ZSTD_inBuffer in = { NULL, 0, 0 };
+        ZSTD_outBuffer out = { NULL, 0, 0 };
+
+        stream = ZSTD_createDStream();
+        if (stream == NULL) {
+            zend_string_efree(output);
+            ZSTD_WARNING("can not create stream");
+            return NULL;
+        }
+
+        result = ZSTD_initDStream(stream);
+        if (ZSTD_IS_ERROR(result)) {
+            zend_string_efree(output);
+            ZSTD_freeDStream(stream);
+            ZSTD_WARNING("can not init stream");
+            return NULL;
+        }
+        php_zstd_dctx_ref_dicts(stream, input, input_len);
+
+        in.src = input;
+        in.size = input_len;
+        in.pos = 0;
+
+        out.dst = ZSTR_VAL(output);
+        out.size = size;
+        out.pos = 0;
+
+        while (1) {
+            if (out.pos == out.size) {
+                out.size += size;
+                output = zend_string_extend(output, out.size, 0);
+                out.dst = ZSTR_VAL(output);
+            }
+
+            result = ZSTD_decompressStream(stream, &out, &in);
+            if (ZSTD_IS_ERROR(result)) {
+                zend_string_efree(output);
+                ZSTD_freeDStream(stream);
+                ZSTD_WARNING("can not decompress stream");
+                return NULL;
+            }
+
+            /* Continue with the next frame, or flush what is left */
+            if (in.pos == in.size && (result == 0 || out.pos < out.size)) {
+                break;
+            }
+        }
+
+        result = out.pos;
+
+        ZSTD_freeDStream(stream);
+    }
+
+    return zstd_string_output_truncate(output, result);
+}
+
+ZEND_FUNCTION(zstd_uncompress)
+{
+    zend_string *output;
+
+    char *input;
+    size_t input_len;
+
+#if PHP_VERSION_ID < 80000
+    zval *data;
+    if (zend_parse_parameters(ZEND_NUM_ARGS(),
+                              "z", &data) == FAILURE) {
+      RETURN_FALSE;
+    }
+    if (Z_TYPE_P(data) != IS_STRING) {
+      zend_error(E_WARNING,
+                 "zstd_uncompress(): expects parameter to be string.");
+      RETURN_FALSE;
+    }
+    input = Z_STRVAL_P(data);
+    input_len = Z_STRLEN_P(data);
+#else
+    ZEND_PARSE_PARAMETERS_START(1, 1)
+        Z_PARAM_STRING(input, input_len)
+    ZEND_PARSE_PARAMETERS_END();
+#endif
+
+    output = php_zstd_uncompress(input, input_len);
+    if (output == NULL) {
+        RETURN_FALSE;
+    }
+
+    RETVAL_NEW_STR(output);
+}
+
+typedef struct _php_zstd_frame_job {
+    const char *src;
+    size_t src_size;
+    char *dst;
+    size_t dst_size;
+    ZSTD_DDict *ddict;
+    size_t result;
+} php_zstd_frame_job;
+
+typedef struct _php_zstd_frame_jobs {
+    php_zstd_frame_job *jobs;
+    size_t count;
+    size_t next;
+#if defined(HAVE_ZSTD_THREADS)
+    pthread_mutex_t lock;
+#endif
+} php_zstd_frame_jobs;
+
+/* Split input at frame boundaries, returns the total decompressed size
+ * or ZSTD_CONTENTSIZE_UNKNOWN/ERROR when it can not be decoded in place */
+static uint64_t php_zstd_frame_jobs_init(php_zstd_frame_jobs *ctx,
+                                         const char *input, size_t input_len)
+{
+    size_t pos = 0, frame_size, allocated = 0;
+    uint64_t total = 0;
+    ZSTD_frameHeader header;
+    php_zstd_dict *dict;
+
+    memset(ctx, 0, sizeof(*ctx));
+
+    while (pos < input_len) {
+        if (ZSTD_getFrameHeader(&header, input + pos, input_len - pos) != 0) {
+            return ZSTD_CONTENTSIZE_ERROR;
+        }
+        frame_size = ZSTD_findFrameCompressedSize(input + pos,
+                                                  input_len - pos);
+        if (ZSTD_IS_ERROR(frame_size)) {
+            return ZSTD_CONTENTSIZE_ERROR;
+        }
+
+        if (header.frameType != ZSTD_skippableFrame) {
+            if (header.frameContentSize == ZSTD_CONTENTSIZE_UNKNOWN
+                || header.frameContentSize > ZSTR_MAX_LEN - total) {
+                return ZSTD_CONTENTSIZE_UNKNOWN;
+            }
+            if (ctx->count == allocated) {
+                allocated = allocated ? allocated * 2 : 16;
+                ctx->jobs = safe_erealloc(ctx->jobs, allocated,
+                                          sizeof(php_zstd_frame_job), 0);
+            }
+            ctx->jobs[ctx->count].src = input + pos;
+            ctx->jobs[ctx->count].src_size = frame_size;
+            ctx->jobs[ctx->count].dst_size = (size_t) header.frameContentSize;
+            dict = php_zstd_dict_find_id(header.dictID);
+            ctx->jobs[ctx->count].ddict = dict ? dict->ddict : NULL;
+            ctx->count++;
+            total += header.frameContentSize;
+        }
+
+        pos += frame_size;
+    }
+
+    if (ctx->count == 0) {
+        return ZSTD_CONTENTSIZE_ERROR;
+    }
+
+    return total;
+}
+
+static void *php_zstd_frame_jobs_run(void *arg)
+{
+    php_zstd_frame_jobs *ctx = (php_zstd_frame_jobs *) arg;
+    php_zstd_frame_job *job;
+    ZSTD_DCtx *dctx;
+    size_t i;
+
+    dctx = ZSTD_createDCtx();
+
+    while (1) {
+#if defined(HAVE_ZSTD_THREADS)
+        pthread_mutex_lock(&ctx->lock);
+        i = ctx->next++;
+        pthread_mutex_unlock(&ctx->lock);
+#else
+        i = ctx->next++;
+#endif
+        if (i >= ctx->count) {
+            break;
+        }
+
+        job = &ctx->jobs[i];
+        if (dctx && job->ddict) {
+            job->result = ZSTD_decompress_usingDDict(dctx,
+                                                     job->dst, job->dst_size,
+                                                     job->src, job->src_size,
+                                                     job->ddict);
+        } else if (dctx) {
+            job->result = ZSTD_decompressDCtx(dctx, job->dst, job->dst_size,
+                                              job->src, job->src_size);
+        } else {
+            job->result = ZSTD_decompress(job->dst, job->dst_size,
+                                          job->src, job->src_size);
+        }
+    }
+
+    ZSTD_freeDCtx(dctx);
+
+    return NULL;
+}
+
+/* Threads started by zstd_uncompress_parallel(), whatever the CPU count */
+#define ZSTD_PARALLEL_WORKERS_MAX 64
+
+ZEND_FUNCTION(zstd_uncompress_parallel)
+{
+    zend_long workers = 0;
+#if defined(HAVE_ZSTD_THREADS)
+    zend_long cpus = 0;
+#endif
+    zend_string *output;
+    php_zstd_frame_jobs ctx;
+    uint64_t size;
+    size_t i, offset = 0;
+
+    char *input;
+    size_t input_len;
+
+    ZEND_PARSE_PARAMETERS_START(1, 2)
+        Z_PARAM_STRING(input, input_len)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_LONG(workers)
+    ZEND_PARSE_PARAMETERS_END();
+
+    if (workers < 0) {
+        ZSTD_WARNING("workers (" ZEND_LONG_FMT ") must be 0 or greater",
+                     workers);
+        RETURN_FALSE;
+    }
+
+    size = php_zstd_frame_jobs_init(&ctx, input, input_len);
+    if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN) {
+        /* Unknown frame sizes, decode sequentially */
+        if (ctx.jobs) {
+            efree(ctx.jobs);
+        }
+        output = php_zstd_uncompress(input, input_len);
+        if (output == NULL) {
+            RETURN_FALSE;
+        }
+        RETURN_NEW_STR(output);
+    }
+
+    output = zend_string_alloc((size_t) size, 0);
+    for (i = 0; i < ctx.count; i++) {
+        ctx.jobs[i].dst = ZSTR_VAL(output) + offset;
+        offset += ctx.jobs[i].dst_size;
+    }
+
+#if defined(HAVE_ZSTD_THREADS)
+    /* More threads than CPUs only add contention */
+#ifdef _SC_NPROCESSORS_ONLN
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (workers == 0) {
+        workers = cpus > 0 ? cpus : 1;
+    }
+    if (cpus > 0 && workers > cpus) {
+        workers = cpus;
+    }
+    if (workers > ZSTD_PARALLEL_WORKERS_MAX) {
+        workers = ZSTD_PARALLEL_WORKERS_MAX;
+    }
+    if ((size_t) workers > ctx.count) {
+        workers = (zend_long) ctx.count;
+    }
+
+    if (workers > 1) {
+        pthread_t *threads = safe_emalloc(workers - 1, sizeof(pthread_t), 0);
+        zend_long started = 0;
+
+        pthread_mutex_init(&ctx.lock, NULL);
+        while (started < workers - 1) {
+            if (pthread_create(&threads[started], NULL,
+                               php_zstd_frame_jobs_run, &ctx) != 0) {
+                break;
+            }
+            started++;
+        }
+        /* The calling thread takes part in decoding as well */
+        php_zstd_frame_jobs_run(&ctx);
+        for (i = 0; i < (size_t) started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        pthread_mutex_destroy(&ctx.lock);
+        efree(threads);
+    } else
+#endif
+    {
+        php_zstd_frame_jobs_run(&ctx);
+    }
+
+    for (i = 0; i < ctx.count; i++) {
+        if (ZSTD_IS_ERROR(ctx.jobs[i].result)
+            || ctx.jobs[i].result != ctx.jobs[i].dst_size) {
+            efree(ctx.jobs);
+            zend_string_efree(output);
+            ZSTD_WARNING("can not decompress stream");
+            RETURN_FALSE;
+        }
+    }
+    efree(ctx.jobs);
+
+    ZSTR_VAL(output)[size] = '\0';
+    RETVAL_NEW_STR(output);
+}
+
+/* Traversable returned by zstd_uncompress_chunks(), every foreach gets
+ * its own iterator and decompression context */
+typedef struct _php_zstd_chunks {
+    zend_string *data;
+    size_t chunk_size;
+    zend_object std;
+} php_zstd_chunks;
+
+typedef struct _php_zstd_chunks_iterator {
+    zend_object_iterator it;
+    ZSTD_DCtx *dctx;
+    ZSTD_inBuffer in;
+    size_t result;
+    zval current;
+    zend_long key;
+} php_zstd_chunks_iterator;
+
+static zend_class_entry *php_zstd_chunks_ce;
+static zend_object_handlers php_zstd_chunks_handlers;
+
+static zend_always_inline php_zstd_chunks *php_zstd_chunks_from_obj(
+    zend_object *obj)
+{
+    return (php_zstd_chunks *) ((char *) obj
+                                - XtOffsetOf(php_zstd_chunks, std));
+}
+
+static zend_object *php_zstd_chunks_create(zend_class_entry *ce)
+{
+    php_zstd_chunks *chunks;
+
+    chunks = ecalloc(1, sizeof(php_zstd_chunks)
+                     + zend_object_properties_size(ce));
+    zend_object_std_init(&chunks->std, ce);
+    object_properties_init(&chunks->std, ce);
+    chunks->std.handlers = &php_zstd_chunks_handlers;
+
+    return &chunks->std;
+}
+
+static void php_zstd_chunks_free(zend_object *obj)
+{
+    php_zstd_chunks *chunks = php_zstd_chunks_from_obj(obj);
+
+    if (chunks->data) {
+        zend_string_release(chunks->data);
+    }
+    zend_object_std_dtor(obj);
+}
+
+/* Private, instances come from zstd_uncompress_chunks() */
+ZEND_METHOD(UncompressChunks, __construct)
+{
+    if (zend_parse_parameters_none() == FAILURE) {
+        return;
+    }
+}
+
+static const zend_function_entry php_zstd_chunks_methods[] = {
+    ZEND_ME(UncompressChunks, __construct,
+            arginfo_zstd_chunks___construct, ZEND_ACC_PRIVATE)
+    ZEND_FE_END
+};
+
+/* Decompress up to chunk_size bytes into current */
+static void php_zstd_chunks_fetch(php_zstd_chunks_iterator *iter)
+{
+    php_zstd_chunks *chunks
+        = php_zstd_chunks_from_obj(Z_OBJ(iter->it.data));
+    ZSTD_outBuffer out;
+    zend_string *chunk;
+
+    zval_ptr_dtor(&iter->current);
+    ZVAL_UNDEF(&iter->current);
+
+    if (iter->dctx == NULL
+        || (iter->in.pos == iter->in.size && iter->result == 0)) {
+        return;
+    }
+
+    chunk = zend_string_alloc(chunks->chunk_size, 0);
+    out.dst = ZSTR_VAL(chunk);
+    out.size = chunks->chunk_size;
+    out.pos = 0;
+
+    while (out.pos < out.size) {
+        /* Every frame done */
+        if (iter->in.pos == iter->in.size && iter->result == 0) {
+            break;
+        }
+
+        iter->result = ZSTD_decompressStream(iter->dctx, &out, &iter->in);
+        if (ZSTD_IS_ERROR(iter->result)) {
+            ZSTD_WARNING("%s", ZSTD_getErrorName(iter->result));
+            break;
+        }
+
+        /* Nothing left to flush and no input to go on with */
+        if (iter->in.pos == iter->in.size && out.pos < out.size
+            && iter->result != 0) {
+            ZSTD_WARNING("can not decompress stream");
+            iter->result = ZSTD_ERROR_CODE(srcSize_wrong);
+            break;
+        }
+    }
+
+    if (ZSTD_IS_ERROR(iter->result)) {
+        /* Stop the iteration */
+        zend_string_efree(chunk);
+        ZSTD_freeDCtx(iter->dctx);
+        iter->dctx = NULL;
+        return;
+    }
+    if (out.pos == 0) {
+        zend_string_efree(chunk);
+        return;
+    }
+
+    iter->key++;
+    ZVAL_NEW_STR(&iter->current,
+                 zstd_string_output_truncate(chunk, out.pos));
+}
+
+static void php_zstd_chunks_it_dtor(zend_object_iterator *it)
+{
+    php_zstd_chunks_iterator *iter = (php_zstd_chunks_iterator *) it;
+
+    if (iter->dctx) {
+        ZSTD_freeDCtx(iter->dctx);
+    }
+    zval_ptr_dtor(&iter->current);
+    zval_ptr_dtor(&iter->it.data);
+}
+
+static int php_zstd_chunks_it_valid(zend_object_iterator *it)
+{
+    php_zstd_chunks_iterator *iter = (php_zstd_chunks_iterator *) it;
+
+    return Z_TYPE(iter->current) == IS_STRING ? SUCCESS : FAILURE;
+}
+
+static zval *php_zstd_chunks_it_current(zend_object_iterator *it)
+{
+    return &((php_zstd_chunks_iterator *) it)->current;
+}
+
+static void php_zstd_chunks_it_key(zend_object_iterator *it, zval *key)
+{
+    ZVAL_LONG(key, ((php_zstd_chunks_iterator *) it)->key);
+}
+
+static void php_zstd_chunks_it_forward(zend_object_iterator *it)
+{
+    php_zstd_chunks_fetch((php_zstd_chunks_iterator *) it);
+}
+
+static void php_zstd_chunks_it_rewind(zend_object_iterator *it)
+{
+    php_zstd_chunks_iterator *iter = (php_zstd_chunks_iterator *) it;
+    php_zstd_chunks *chunks
+        = php_zstd_chunks_from_obj(Z_OBJ(iter->it.data));
+
+    iter->key = -1;
+    iter->result = 1;
+    iter->in.src = chunks->data ? ZSTR_VAL(chunks->data) : NULL;
+    iter->in.size = chunks->data ? ZSTR_LEN(chunks->data) : 0;
+    iter->in.pos = 0;
+
+    if (iter->dctx == NULL && chunks->data) {
+        iter->dctx = ZSTD_createDCtx();
+        if (iter->dctx == NULL) {
+            ZSTD_WARNING("ZSTD_createDCtx() error");
+        }
+    }
+    if (iter->dctx) {
+        ZSTD_initDStream(iter->dctx);
+        php_zstd_dctx_ref_dicts(iter->dctx, iter->in.src, iter->in.size);
+    }
+
+    php_zstd_chunks_fetch(iter);
+}
+
+static zend_object_iterator_funcs php_zstd_chunks_iterator_funcs = {
+    php_zstd_chunks_it_dtor,
+    php_zstd_chunks_it_valid,
+    php_zstd_chunks_it_current,
+    php_zstd_chunks_it_key,
+    php_zstd_chunks_it_forward,
+    php_zstd_chunks_it_rewind,
+    NULL,
+#if PHP_VERSION_ID >= 80000
+    NULL,
+#endif
+};
+
+static zend_object_iterator *php_zstd_chunks_get_iterator(
+    zend_class_entry *ce, zval *object, int by_ref)
+{
+    php_zstd_chunks_iterator *iter;
+
+    if (by_ref) {
+        zend_throw_error(NULL, "An iterator cannot be used with foreach "
+                         "by reference");
+        return NULL;
+    }
+
+    iter = ecalloc(1, sizeof(php_zstd_chunks_iterator));
+    zend_iterator_init(&iter->it);
+    ZVAL_COPY(&iter->it.data, object);
+    iter->it.funcs = &php_zstd_chunks_iterator_funcs;
+    ZVAL_UNDEF(&iter->current);
+
+    return &iter->it;
+}
+
+static void php_zstd_chunks_register(void)
+{
+    zend_class_entry ce;
+
+    INIT_NS_CLASS_ENTRY(ce, PHP_ZSTD_NS, "UncompressChunks",
+                        php_zstd_chunks_methods);
+    php_zstd_chunks_ce = zend_register_internal_class(&ce);
+    php_zstd_chunks_ce->ce_flags |= ZEND_ACC_FINAL;
+#if PHP_VERSION_ID >= 80100
+    php_zstd_chunks_ce->ce_flags |= ZEND_ACC_NOT_SERIALIZABLE;
+#else
+    php_zstd_chunks_ce->serialize = zend_class_serialize_deny;
+    php_zstd_chunks_ce->unserialize = zend_class_unserialize_deny;
+#endif
+    php_zstd_chunks_ce->create_object = php_zstd_chunks_create;
+    php_zstd_chunks_ce->get_iterator = php_zstd_chunks_get_iterator;
+    zend_class_implements(php_zstd_chunks_ce, 1, zend_ce_traversable);
+
+    memcpy(&php_zstd_chunks_handlers, zend_get_std_object_handlers(),
+           sizeof(zend_object_handlers));
+    php_zstd_chunks_handlers.offset = XtOffsetOf(php_zstd_chunks, std);
+    php_zstd_chunks_handlers.free_obj = php_zstd_chunks_free;
+    php_zstd_chunks_handlers.clone_obj = NULL;
+}
+
+ZEND_FUNCTION(zstd_uncompress_chunks)
+{
+    php_zstd_chunks *chunks;
+    zend_string *data;
+    zend_long chunk_size;
+    ZSTD_frameHeader header;
+
+    ZEND_PARSE_PARAMETERS_START(2, 2)
+        Z_PARAM_STR(data)
+        Z_PARAM_LONG(chunk_size)
+    ZEND_PARSE_PARAMETERS_END();
+
+    if (chunk_size <= 0) {
+        ZSTD_WARNING("chunk size (" ZEND_LONG_FMT ") must be greater than 0",
+                     chunk_size);
+        RETURN_FALSE;
+    }
+    if (ZSTD_getFrameHeader(&header, ZSTR_VAL(data), ZSTR_LEN(data)) != 0) {
+        ZSTD_WARNING("it was not compressed by zstd");
+        RETURN_FALSE;
+    }
+
+    object_init_ex(return_value, php_zstd_chunks_ce);
+    chunks = php_zstd_chunks_from_obj(Z_OBJ_P(return_value));
+    chunks->data = zend_string_copy(data);
+    chunks->chunk_size = (size_t) chunk_size;
+}
+
+ZEND_FUNCTION(zstd_compress_dict)
+{
+    zend_long level = DEFAULT_COMPRESS_LEVEL;
+    zend_long flags = 0;
+
+    zend_string *output, *data, *dict_str;
+    char *input, *dict;
+    size_t input_len, dict_len, cSize;
+
+    ZEND_PARSE_PARAMETERS_START(2, 4)
+        Z_PARAM_STR(data)
+        Z_PARAM_STR(dict_str)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_LONG(level)
+        Z_PARAM_LONG(flags)
+    ZEND_PARSE_PARAMETERS_END();
+
+    if (!zstd_check_compress_level(level)) {
+        RETURN_FALSE;
+    }
+
+    /* Only the compact format applies to dictionary compression */
+#if ZSTD_VERSION_NUMBER >= 10400
+    flags &= PHP_ZSTD_COMPRESS_COMPACT;
+#else
+    flags = 0;
+#endif
+
+    input = ZSTR_VAL(data);
+    input_len = ZSTR_LEN(data);
+    dict = ZSTR_VAL(dict_str);
+    dict_len = ZSTR_LEN(dict_str);
+
+    output = php_zstd_memo_find(data, level, flags, dict_str);
+    if (output) {
+        RETURN_STR(output);
+    }
+
+    ZSTD_CCtx* const cctx = ZSTD_createCCtx();
+    if (cctx == NULL) {
+        ZSTD_WARNING("ZSTD_createCCtx() error");
+        RETURN_FALSE;
+    }
+    int cdict_owned;
+    ZSTD_CDict* const cdict = php_zstd_cdict(dict,
+                                             dict_len,
+                                             (int)level, &cdict_owned);
+    if (!cdict) {
+        ZSTD_freeCStream(cctx);
+        ZSTD_WARNING("ZSTD_createCDict() error");
+        RETURN_FALSE;
+    }
+
+    size_t const cBuffSize = ZSTD_compressBound(input_len) + (flags ? 1 : 0);
+    char *buf = php_zstd_output_alloc(&output, cBuffSize);
+
+#if ZSTD_VERSION_NUMBER >= 10400
+    if (flags & PHP_ZSTD_COMPRESS_COMPACT) {
+        cSize = php_zstd_compress_compact(buf, cBuffSize, input, input_len,
+                                          (int)level, cdict, 0);
+    } else
+#endif
+    cSize = ZSTD_compress_usingCDict(cctx, buf, cBuffSize,
+                                     input,
+                                     input_len,
+                                     cdict);
+    if (ZSTD_IS_ERROR(cSize)) {
+        ZSTD_freeCStream(cctx);
+        if (cdict_owned) {
+            ZSTD_freeCDict(cdict);
+        }
+        php_zstd_output_free(output);
+        ZSTD_WARNING("%s", ZSTD_getErrorName(cSize));
+        RETURN_FALSE;
+    }
+
+    output = php_zstd_output_exact(output, buf, cSize);
+    php_zstd_memo_add(data, output, level, flags, dict_str);
+    RETVAL_NEW_STR(output);
+
+    ZSTD_freeCCtx(cctx);
+    if (cdict_owned) {
+        ZSTD_freeCDict(cdict);
+    }
+}
+
+ZEND_FUNCTION(zstd_uncompress_dict)
+{
+    char *input, *dict;
+    size_t input_len, dict_len;
+    zend_string *output;
+
+    ZEND_PARSE_PARAMETERS_START(2, 2)
+        Z_PARAM_STRING(input, input_len)
+        Z_PARAM_STRING(dict, dict_len)
+    ZEND_PARSE_PARAMETERS_END();
+
+#if ZSTD_VERSION_NUMBER >= 10400
+    if (zstd_is_compact(input, input_len)) {
+        int compact_ddict_owned;
+        ZSTD_DDict *compact_ddict = php_zstd_ddict(dict, dict_len,
+                                                   &compact_ddict_owned);
+        if (!compact_ddict) {
+            ZSTD_WARNING("ZSTD_createDDict() error");
+            RETURN_FALSE;
+        }
+        output = php_zstd_uncompress_compact(input, input_len,
+                                             compact_ddict);
+        if (compact_ddict_owned) {
+            ZSTD_freeDDict(compact_ddict);
+        }
+        if (output == NULL) {
+            ZSTD_WARNING("can not decompress stream");
+            RETURN_FALSE;
+        }
+        RETURN_NEW_STR(output);
+    }
+#endif
+
+    unsigned long long const rSize = ZSTD_getFrameContentSize(input,
+                                                              input_len);
+
+    if (rSize == 0 || rSize == ZSTD_CONTENTSIZE_ERROR) {
+        ZSTD_WARNING("it was not compressed by zstd");
+        RETURN_FALSE;
+    }
+
+    ZSTD_DCtx* const dctx = ZSTD_createDCtx();
+    if (dctx == NULL) {
+        ZSTD_WARNING("ZSTD_createDCtx() error");
+        RETURN_FALSE;
+    }
+    int ddict_owned;
+    ZSTD_DDict* const ddict = php_zstd_ddict(dict,
+                                             dict_len, &ddict_owned);
+    if (!ddict) {
+        ZSTD_freeDStream(dctx);
+        ZSTD_WARNING("ZSTD_createDDict() error");
+        RETURN_FALSE;
+    }
+
+    output = zend_string_alloc(rSize, 0);
+
+    size_t const dSize = ZSTD_decompress_usingDDict(dctx, ZSTR_VAL(output), rSize,
+                                                    input,
+                                                    input_len,
+                                                    ddict);
+    if (dSize != rSize) {
+        ZSTD_freeDStream(dctx);
+        if (ddict_owned) {
+            ZSTD_freeDDict(ddict);
+        }
+        zend_string_efree(output);
+        ZSTD_WARNING("%s", ZSTD_getErrorName(dSize));
+        RETURN_FALSE;
+    }
+    ZSTD_freeDCtx(dctx);
+    if (ddict_owned) {
+        ZSTD_freeDDict(ddict);
+    }
+
+    output = zstd_string_output_truncate(output, dSize);
+    RETVAL_NEW_STR(output);
+}
+
+#if ZSTD_VERSION_NUMBER >= 10400
+// Window large enough to reference the whole base, like zstd --patch-from
+static int zstd_delta_window_log(size_t base_len, size_t input_len)
+{
+    size_t size = base_len > input_len ? base_len : input_len;
+    int window_log = 1;
+
+    while (size >>= 1) {
+        window_log++;
+    }
+
+    if (window_log < ZSTD_WINDOWLOG_MIN) {
+        window_log = ZSTD_WINDOWLOG_MIN;
+    } else if (window_log > ZSTD_WINDOWLOG_MAX) {
+        window_log = ZSTD_WINDOWLOG_MAX;
+    }
+    return window_log;
+}
+
+ZEND_FUNCTION(zstd_compress_delta)
+{
+    zend_long level = DEFAULT_COMPRESS_LEVEL;
+
+    zend_string *output;
+    char *input, *base, *buf;
+    size_t input_len, base_len, size, result;
+    ZSTD_CCtx *cctx;
+
+    ZEND_PARSE_PARAMETERS_START(2, 3)
+        Z_PARAM_STRING(input, input_len)
+        Z_PARAM_STRING(base, base_len)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_LONG(level)
+    ZEND_PARSE_PARAMETERS_END();
+
+    if (!zstd_check_compress_level(level)) {
+        RETURN_FALSE;
+    }
+
+    cctx = ZSTD_createCCtx();
+    if (cctx == NULL) {
+        ZSTD_WARNING("ZSTD_createCCtx() error");
+        RETURN_FALSE;
+    }
+
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, (int)level);
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog,
+                           zstd_delta_window_log(base_len, input_len));
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_enableLongDistanceMatching, 1);
+
+    result = ZSTD_CCtx_refPrefix(cctx, base, base_len);
+    if (ZSTD_IS_ERROR(result)) {
+        ZSTD_freeCCtx(cctx);
+        ZSTD_WARNING("%s", ZSTD_getErrorName(result));
+        RETURN_FALSE;
+    }
+
+    size = ZSTD_compressBound(input_len);
+    buf = php_zstd_output_alloc(&output, size);
+
+    result = ZSTD_compress2(cctx, buf, size, input, input_len);
+    ZSTD_freeCCtx(cctx);
+
+    if (ZSTD_IS_ERROR(result)) {
+        php_zstd_output_free(output);
+        ZSTD_WARNING("%s", ZSTD_getErrorName(result));
+        RETURN_FALSE;
+    }
+
+    output = php_zstd_output_exact(output, buf, result);
+    RETVAL_NEW_STR(output);
+}
+
+ZEND_FUNCTION(zstd_uncompress_delta)
+{
+    zend_string *output;
+    char *input, *base;
+    size_t input_len, base_len, result;
+    uint64_t size;
+    ZSTD_DCtx *dctx;
+
+    ZEND_PARSE_PARAMETERS_START(2, 2)
+        Z_PARAM_STRING(input, input_len)
+        Z_PARAM_STRING(base, base_len)
+    ZEND_PARSE_PARAMETERS_END();
+
+    size = ZSTD_getFrameContentSize(input, input_len);
+    if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN) {
+        ZSTD_WARNING("it was not compressed by zstd");
+        RETURN_FALSE;
+    }
+    if (size > ZSTR_MAX_LEN) {
+        ZSTD_WARNING("content size is too large");
+        RETURN_FALSE;
+    }
+
+    dctx = ZSTD_createDCtx();
+    if (dctx == NULL) {
+        ZSTD_WARNING("ZSTD_createDCtx() error");
+        RETURN_FALSE;
+    }
+
+    ZSTD_DCtx_setParameter(dctx, ZSTD_d_windowLogMax,
+                           zstd_delta_window_log(base_len, (size_t) size));
+
+    result = ZSTD_DCtx_refPrefix(dctx, base, base_len);
+    if (ZSTD_IS_ERROR(result)) {
+        ZSTD_freeDCtx(dctx);
+        ZSTD_WARNING("%s", ZSTD_getErrorName(result));
+        RETURN_FALSE;
+    }
+
+    output = zend_string_alloc(size, 0);
+
+    result = ZSTD_decompressDCtx(dctx, ZSTR_VAL(output), size,
+                                 input, input_len);
+    ZSTD_freeDCtx(dctx);
+
+    if (result != size) {
+        zend_string_efree(output);
+        ZSTD_WARNING("%s", ZSTD_getErrorName(result));
+        RETURN_FALSE;
+    }
+
+    output = zstd_string_output_truncate(output, result);
+    RETVAL_NEW_STR(output);
+}
+#endif
+
+/* Fills return_value with the description of the frames, returns 0
+ * with a warning when the data is not valid */
+static int php_zstd_frame_info(zval *return_value,
+                               const char *input, size_t input_len)
+{
+    size_t pos = 0, frame_size, result;
+    zend_long frames = 0, skippable_frames = 0;
+    uint64_t content_size = 0, window_size = 0;
+    zend_bool content_size_known = 1, checksum = 1;
+    unsigned int dict_id = 0;
+    ZSTD_frameHeader header;
+    zval frame_sizes;
+
+    if (input_len == 0) {
+        ZSTD_WARNING("it was not compressed by zstd");
+        return 0;
+    }
+
+    array_init(&frame_sizes);
+
+#if ZSTD_VERSION_NUMBER >= 10400
+    /* A compact frame runs up to the end of the data */
+    if (zstd_is_compact(input, input_len)) {
+        if (ZSTD_getFrameHeader_advanced(&header, input + 1, input_len - 1,
+                                         ZSTD_f_zstd1_magicless) != 0
+            || header.frameType != ZSTD_frame) {
+            zval_ptr_dtor(&frame_sizes);
+            ZSTD_WARNING("it was not compressed by zstd");
+            return 0;
+        }
+        frames = 1;
+        if (header.frameContentSize == ZSTD_CONTENTSIZE_UNKNOWN) {
+            content_size_known = 0;
+        } else {
+            content_size = header.frameContentSize;
+        }
+        window_size = header.windowSize;
+        dict_id = header.dictID;
+        checksum = header.checksumFlag;
+        add_next_index_long(&frame_sizes, (zend_long) input_len);
+        pos = input_len;
+    }
+#endif
+
+    while (pos < input_len) {
+        result = ZSTD_getFrameHeader(&header, input + pos, input_len - pos);
+        if (result != 0) {
+            zval_ptr_dtor(&frame_sizes);
+            ZSTD_WARNING("it was not compressed by zstd");
+            return 0;
+        }
+
+        frame_size = ZSTD_findFrameCompressedSize(input + pos,
+                                                  input_len - pos);
+        if (ZSTD_IS_ERROR(frame_size)) {
+            zval_ptr_dtor(&frame_sizes);
+            ZSTD_WARNING("%s", ZSTD_getErrorName(frame_size));
+            return 0;
+        }
+
+        if (header.frameType == ZSTD_skippableFrame) {
+            skippable_frames++;
+        } else {
+            frames++;
+            if (header.frameContentSize == ZSTD_CONTENTSIZE_UNKNOWN) {
+                content_size_known = 0;
+            } else {
+                content_size += header.frameContentSize;
+            }
+            if (header.windowSize > window_size) {
+                window_size = header.windowSize;
+            }
+            if (dict_id == 0) {
+                dict_id = header.dictID;
+            }
+            if (!header.checksumFlag) {
+                checksum = 0;
+            }
+        }
+
+        add_next_index_long(&frame_sizes, (zend_long) frame_size);
+        pos += frame_size;
+    }
+
+    array_init(return_value);
+    add_assoc_long(return_value, "frames", frames);
+    add_assoc_long(return_value, "skippable_frames", skippable_frames);
+    if (frames > 0 && content_size_known) {
+        add_assoc_long(return_value, "content_size", (zend_long) content_size);
+    } else {
+        add_assoc_null(return_value, "content_size");
+    }
+    add_assoc_long(return_value, "window_size", (zend_long) window_size);
+    add_assoc_long(return_value, "dict_id", (zend_long) dict_id);
+    add_assoc_bool(return_value, "checksum", frames > 0 && checksum);
+    add_assoc_zval(return_value, "frame_sizes", &frame_sizes);
+    return 1;
+}
+
+ZEND_FUNCTION(zstd_get_frame_info)
+{
+    char *input;
+    size_t input_len;
+
+    ZEND_PARSE_PARAMETERS_START(1, 1)
+        Z_PARAM_STRING(input, input_len)
+    ZEND_PARSE_PARAMETERS_END();
+
+    if (!php_zstd_frame_info(return_value, input, input_len)) {
+        RETURN_FALSE;
+    }
+}
+
+ZEND_FUNCTION(zstd_frame_checksum)
+{
+    char *input;
+    size_t input_len, pos = 0, frame_size;
+    const unsigned char *end;
+    ZSTD_frameHeader header;
+
+    ZEND_PARSE_PARAMETERS_START(1, 1)
+        Z_PARAM_STRING(input, input_len)
+    ZEND_PARSE_PARAMETERS_END();
+
+#if ZSTD_VERSION_NUMBER >= 10400
+    /* A compact frame runs up to the end of the data */
+    if (zstd_is_compact(input, input_len)) {
+        if (input_len < 5
+            || ZSTD_getFrameHeader_advanced(&header, input + 1, input_len - 1,
+                                            ZSTD_f_zstd1_magicless) != 0) {
+            ZSTD_WARNING("it was not compressed by zstd");
+            RETURN_FALSE;
+        }
+        if (!header.checksumFlag) {
+            RETURN_NULL();
+        }
+        end = (const unsigned char *) input + input_len;
+        RETURN_LONG((zend_long) ((uint32_t) end[-4]
+                                 | (uint32_t) end[-3] << 8
+                                 | (uint32_t) end[-2] << 16
+                                 | (uint32_t) end[-1] << 24));
+    }
+#endif
+
+    /* First regular frame, after any skippable frames */
+    do {
+        if (pos >= input_len
+            || ZSTD_getFrameHeader(&header, input + pos,
+                                   input_len - pos) != 0) {
+            ZSTD_WARNING("it was not compressed by zstd");
+            RETURN_FALSE;
+        }
+        frame_size = ZSTD_findFrameCompressedSize(input + pos,
+                                                  input_len - pos);
+        if (ZSTD_IS_ERROR(frame_size)) {
+            ZSTD_WARNING("%s", ZSTD_getErrorName(frame_size));
+            RETURN_FALSE;
+        }
+        pos += frame_size;
+    } while (header.frameType == ZSTD_skippableFrame);
+
+    if (!header.checksumFlag) {
+        RETURN_NULL();
+    }
+
+    /* The checksum is stored little-endian after the last block */
+    end = (const unsigned char *) input + pos;
+    RETURN_LONG((zend_long) ((uint32_t) end[-4]
+                             | (uint32_t) end[-3] << 8
+                             | (uint32_t) end[-2] << 16
+                             | (uint32_t) end[-1] << 24));
+}
+
+/* Zstd\CompressedString: compressed data decompressed on first use */
+typedef struct _php_zstd_compressed {
+    zend_string *data;
+    zend_string *contents;
+    zend_bool cache;
+    zend_object std;
+} php_zstd_compressed;
+
+static zend_class_entry *php_zstd_compressed_ce;
+static zend_object_handlers php_zstd_compressed_handlers;
+
+static zend_always_inline php_zstd_compressed *php_zstd_compressed_from_obj(
+    zend_object *obj)
+{
+    return (php_zstd_compressed *) ((char *) obj
+                                    - XtOffsetOf(php_zstd_compressed, std));
+}
+
+#define COMPRESSED_FROM_THIS() \
+    php_zstd_compressed *self = php_zstd_compressed_from_obj(Z_OBJ_P(getThis()))
+
+static zend_object *php_zstd_compressed_create(zend_class_entry *ce)
+{
+    php_zstd_compressed *compressed;
+
+    compressed = ecalloc(1, sizeof(php_zstd_compressed)
+                         + zend_object_properties_size(ce));
+    zend_object_std_init(&compressed->std, ce);
+    object_properties_init(&compressed->std, ce);
+    compressed->std.handlers = &php_zstd_compressed_handlers;
+    compressed->cache = 1;
+
+    return &compressed->std;
+}
+
+static void php_zstd_compressed_free(zend_object *obj)
+{
+    php_zstd_compressed *compressed = php_zstd_compressed_from_obj(obj);
+
+    if (compressed->data) {
+        zend_string_release(compressed->data);
+    }
+    if (compressed->contents) {
+        zend_string_release(compressed->contents);
+    }
+    zend_object_std_dtor(obj);
+}
+
+#if PHP_VERSION_ID >= 80000
+static zend_object *php_zstd_compressed_clone(zend_object *obj)
+{
+#else
+static zend_object *php_zstd_compressed_clone(zval *object)
+{
+    zend_object *obj = Z_OBJ_P(object);
+#endif
+    php_zstd_compressed *old = php_zstd_compressed_from_obj(obj);
+    php_zstd_compressed *new;
+
+    new = php_zstd_compressed_from_obj(
+        php_zstd_compressed_create(obj->ce));
+    zend_objects_clone_members(&new->std, obj);
+
+    if (old->data) {
+        new->data = zend_string_copy(old->data);
+    }
+    if (old->contents) {
+        new->contents = zend_string_copy(old->contents);
+    }
+    new->cache = old->cache;
+
+    return &new->std;
+}
+
+static int php_zstd_compressed_valid(zend_string *data)
+{
+    ZSTD_frameHeader header;
+
+#if ZSTD_VERSION_NUMBER >= 10400
+    if (zstd_is_compact(ZSTR_VAL(data), ZSTR_LEN(data))) {
+        return ZSTD_getFrameHeader_advanced(&header, ZSTR_VAL(data) + 1,
+                                            ZSTR_LEN(data) - 1,
+                                            ZSTD_f_zstd1_magicless) == 0;
+    }
+#endif
+    return ZSTD_getFrameHeader(&header, ZSTR_VAL(data), ZSTR_LEN(data)) == 0;
+}
+
+static void php_zstd_compressed_init(php_zstd_compressed *self,
+                                     zend_string *data, zend_bool cache)
+{
+    if (self->data) {
+        zend_string_release(self->data);
+    }
+    if (self->contents) {
+        zend_string_release(self->contents);
+        self->contents = NULL;
+    }
+    self->data = zend_string_copy(data);
+    self->cache = cache;
+}
+
+/* Decompressed data with a new reference, NULL with a warning on error */
+static zend_string *php_zstd_compressed_contents(php_zstd_compressed *self)
+{
+    zend_string *contents;
+
+    if (self->contents) {
+        return zend_string_copy(self->contents);
+    }
+    if (self->data == NULL) {
+        return ZSTR_EMPTY_ALLOC();
+    }
+
+    contents = php_zstd_uncompress(ZSTR_VAL(self->data),
+                                   ZSTR_LEN(self->data));
+    if (contents && self->cache) {
+        self->contents = zend_string_copy(contents);
+    }
+    return contents;
+}
+
+ZEND_METHOD(CompressedString, __construct)
+{
+    zend_string *data;
+    zend_bool cache = 1;
+
+    ZEND_PARSE_PARAMETERS_START(1, 2)
+        Z_PARAM_STR(data)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_BOOL(cache)
+    ZEND_PARSE_PARAMETERS_END();
+
+    COMPRESSED_FROM_THIS();
+
+    if (!php_zstd_compressed_valid(data)) {
+        zend_throw_error(NULL, "Data was not compressed by zstd");
+        return;
+    }
+    php_zstd_compressed_init(self, data, cache);
+}
+
+ZEND_METHOD(CompressedString, compress)
+{
+    zend_string *output;
+    zend_long level = DEFAULT_COMPRESS_LEVEL;
+    zend_long flags = 0;
+    zend_bool cache = 1;
+    zend_string *input;
+
+    ZEND_PARSE_PARAMETERS_START(1, 4)
+        Z_PARAM_STR(input)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_LONG(level)
+        Z_PARAM_LONG(flags)
+        Z_PARAM_BOOL(cache)
+    ZEND_PARSE_PARAMETERS_END();
+
+    if (!zstd_check_compress_level(level)) {
+        RETURN_FALSE;
+    }
+
+    output = php_zstd_memo_find(input, level, flags, NULL);
+    if (output == NULL) {
+        output = php_zstd_compress(ZSTR_VAL(input), ZSTR_LEN(input),
+                                   (int) level, flags);
+        if (output == NULL) {
+            RETURN_FALSE;
+        }
+        php_zstd_memo_add(input, output, level, flags, NULL);
+    }
+
+    object_init_ex(return_value, php_zstd_compressed_ce);
+    php_zstd_compressed_init(php_zstd_compressed_from_obj(
+                                 Z_OBJ_P(return_value)), output, cache);
+    zend_string_release(output);
+}
+
+ZEND_METHOD(CompressedString, getContents)
+{
+    zend_string *contents;
+
+    if (zend_parse_parameters_none() == FAILURE) {
+        return;
+    }
+
+    COMPRESSED_FROM_THIS();
+
+    contents = php_zstd_compressed_contents(self);
+    if (contents == NULL) {
+        RETURN_FALSE;
+    }
+    RETURN_STR(contents);
+}
+
+ZEND_METHOD(CompressedString, __toString)
+{
+    zend_string *contents;
+
+    if (zend_parse_parameters_none() == FAILURE) {
+        return;
+    }
+
+    COMPRESSED_FROM_THIS();
+
+    contents = php_zstd_compressed_contents(self);
+    if (contents == NULL) {
+#if PHP_VERSION_ID >= 70400
+        zend_throw_error(NULL, "Data can not be decompressed");
+        return;
+#else
+        /* __toString() can not throw before PHP 7.4 */
+        RETURN_EMPTY_STRING();
+#endif
+    }
+    RETURN_STR(contents);
+}
+
+ZEND_METHOD(CompressedString, getCompressed)
+{
+    if (zend_parse_parameters_none() == FAILURE) {
+        return;
+    }
+
+    COMPRESSED_FROM_THIS();
+
+    if (self->data == NULL) {
+        RETURN_EMPTY_STRING();
+    }
+    RETURN_STR_COPY(self->data);
+}
+
+ZEND_METHOD(CompressedString, getSize)
+{
+    unsigned long long size;
+
+    if (zend_parse_parameters_none() == FAILURE) {
+        return;
+    }
+
+    COMPRESSED_FROM_THIS();
+
+    if (self->contents) {
+        RETURN_LONG((zend_long) ZSTR_LEN(self->contents));
+    }
+    if (self->data == NULL) {
+        RETURN_LONG(0);
+    }
+
+#if ZSTD_VERSION_NUMBER >= 10400
+    if (zstd_is_compact(ZSTR_VAL(self->data), ZSTR_LEN(self->data))) {
+        ZSTD_frameHeader header;
+
+        if (ZSTD_getFrameHeader_advanced(&header, ZSTR_VAL(self->data) + 1,
+                                         ZSTR_LEN(self->data) - 1,
+                                         ZSTD_f_zstd1_magicless) != 0) {
+            RETURN_NULL();
+        }
+        size = header.frameContentSize;
+    } else
+#endif
+    size = ZSTD_findDecompressedSize(ZSTR_VAL(self->data),
+                                     ZSTR_LEN(self->data));
+
+    if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR
+        || size > ZEND_LONG_MAX) {
+        RETURN_NULL();
+    }
+    RETURN_LONG((zend_long) size);
+}
+
+ZEND_METHOD(CompressedString, getFrameInfo)
+{
+    if (zend_parse_parameters_none() == FAILURE) {
+        return;
+    }
+
+    COMPRESSED_FROM_THIS();
+
+    if (self->data == NULL
+        || !php_zstd_frame_info(return_value, ZSTR_VAL(self->data),
+                                ZSTR_LEN(self->data))) {
+        RETURN_FALSE;
+    }
+}
+
+ZEND_METHOD(CompressedString, isCached)
+{
+    if (zend_parse_parameters_none() == FAILURE) {
+        return;
+    }
+
+    COMPRESSED_FROM_THIS();
+
+    RETURN_BOOL(self->contents != NULL);
+}
+
+ZEND_METHOD(CompressedString, __serialize)
+{
+    if (zend_parse_parameters_none() == FAILURE) {
+        return;
+    }
+
+    COMPRESSED_FROM_THIS();
+
+    /* Only the compressed data, never the cached contents */
+    array_init(return_value);
+    if (self->data) {
+        add_next_index_str(return_value, zend_string_copy(self->data));
+    } else {
+        add_next_index_str(return_value, ZSTR_EMPTY_ALLOC());
+    }
+    add_next_index_bool(return_value, self->cache);
+}
+
+ZEND_METHOD(CompressedString, __unserialize)
+{
+    HashTable *data;
+    zval *value, *cache;
+
+    ZEND_PARSE_PARAMETERS_START(1, 1)
+        Z_PARAM_ARRAY_HT(data)
+    ZEND_PARSE_PARAMETERS_END();
+
+    COMPRESSED_FROM_THIS();
+
+    value = zend_hash_index_find(data, 0);
+    cache = zend_hash_index_find(data, 1);
+    if (value == NULL || Z_TYPE_P(value) != IS_STRING
+        || !php_zstd_compressed_valid(Z_STR_P(value))) {
+        zend_throw_error(NULL, "Invalid serialization data for %s object",
+                         ZSTR_VAL(php_zstd_compressed_ce->name));
+        return;
+    }
+    php_zstd_compressed_init(self, Z_STR_P(value),
+                             cache == NULL || zend_is_true(cache));
+}
+
+static const zend_function_entry php_zstd_compressed_methods[] = {
+    ZEND_ME(CompressedString, __construct,
+            arginfo_zstd_compressed___construct, ZEND_ACC_PUBLIC)
+    ZEND_ME(CompressedString, compress,
+            arginfo_zstd_compressed_compress,
+            ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+    ZEND_ME(CompressedString, getContents,
+            arginfo_zstd_compressed_void, ZEND_ACC_PUBLIC)
+    ZEND_ME(CompressedString, __toString,
+            arginfo_zstd_compressed___tostring, ZEND_ACC_PUBLIC)
+    ZEND_ME(CompressedString, getCompressed,
+            arginfo_zstd_compressed_void, ZEND_ACC_PUBLIC)
+    ZEND_ME(CompressedString, getSize,
+            arginfo_zstd_compressed_void, ZEND_ACC_PUBLIC)
+    ZEND_ME(CompressedString, getFrameInfo,
+            arginfo_zstd_compressed_void, ZEND_ACC_PUBLIC)
+    ZEND_ME(CompressedString, isCached,
+            arginfo_zstd_compressed_void, ZEND_ACC_PUBLIC)
+    ZEND_ME(CompressedString, __serialize,
+            arginfo_zstd_compressed___serialize, ZEND_ACC_PUBLIC)
+    ZEND_ME(CompressedString, __unserialize,
+            arginfo_zstd_compressed___unserialize, ZEND_ACC_PUBLIC)
+    {NULL, NULL, NULL}
+};
+
+static void php_zstd_compressed_register(void)
+{
+    zend_class_entry ce;
+
+    INIT_NS_CLASS_ENTRY(ce, PHP_ZSTD_NS, "CompressedString",
+                        php_zstd_compressed_methods);
+    php_zstd_compressed_ce = zend_register_internal_class(&ce);
+    php_zstd_compressed_ce->ce_flags |= ZEND_ACC_FINAL;
+#if PHP_VERSION_ID < 70400
+    /* No __serialize() */
+    php_zstd_compressed_ce->serialize = zend_class_serialize_deny;
+    php_zstd_compressed_ce->unserialize = zend_class_unserialize_deny;
+#endif
+    php_zstd_compressed_ce->create_object = php_zstd_compressed_create;
+
+    memcpy(&php_zstd_compressed_handlers, zend_get_std_object_handlers(),
+           sizeof(zend_object_handlers));
+    php_zstd_compressed_handlers.offset
+        = XtOffsetOf(php_zstd_compressed, std);
+    php_zstd_compressed_handlers.free_obj = php_zstd_compressed_free;
+    php_zstd_compressed_handlers.clone_obj = php_zstd_compressed_clone;
+}
+
+ZEND_FUNCTION(zstd_dict_register)
+{
+    php_zstd_dict *dict;
+    unsigned int id;
+
+    char *data;
+    size_t data_len;
+
+    ZEND_PARSE_PARAMETERS_START(1, 1)
+        Z_PARAM_STRING(data, data_len)
+    ZEND_PARSE_PARAMETERS_END();
+
+    id = ZSTD_getDictID_fromDict(data, data_len);
+    if (id == 0) {
+        ZSTD_WARNING("dictionary has no dictionary ID");
+        RETURN_FALSE;
+    }
+
+    dict = php_zstd_dict_find_id(id);
+    if (dict) {
+        if (dict->size != data_len || memcmp(dict->data, data, data_len)) {
+            ZSTD_WARNING("dictionary ID %u is already registered"
+                         " with another dictionary", id);
+            RETURN_FALSE;
+        }
+    } else {
+        /* Kept for the lifetime of the process, like preloaded ones */
+        if (zend_hash_num_elements(&PHP_ZSTD_G(registered_dicts))
+            >= ZSTD_DICT_REGISTER_MAX) {
+            ZSTD_WARNING("can not register more than %d dictionaries",
+                         ZSTD_DICT_REGISTER_MAX);
+            RETURN_FALSE;
+        }
+        dict = pecalloc(1, sizeof(php_zstd_dict), 1);
+        dict->size = data_len;
+        dict->data = pemalloc(data_len, 1);
+        memcpy(dict->data, data, data_len);
+        dict->id = id;
+        dict->ddict = ZSTD_createDDict_byReference(dict->data, dict->size);
+        if (dict->ddict == NULL) {
+            pefree(dict->data, 1);
+            pefree(dict, 1);
+            ZSTD_WARNING("ZSTD_createDDict() error");
+            RETURN_FALSE;
+        }
+        zend_hash_index_update_ptr(&PHP_ZSTD_G(registered_dicts), id, dict);
+    }
+
+    RETURN_LONG(id);
+}
+
+
+#if ZSTD_VERSION_NUMBER >= 10400
+static ZSTD_CCtx *php_zstd_serialize_cctx(void)
+{
+    if (PHP_ZSTD_G(cctx) == NULL) {
+        PHP_ZSTD_G(cctx) = ZSTD_createCCtx();
+    } else {
+        ZSTD_CCtx_reset(PHP_ZSTD_G(cctx), ZSTD_reset_session_and_parameters);
+    }
+    return PHP_ZSTD_G(cctx);
+}
+
+static ZSTD_DCtx *php_zstd_serialize_dctx(void)
+{
+    if (PHP_ZSTD_G(dctx) == NULL) {
+        PHP_ZSTD_G(dctx) = ZSTD_createDCtx();
+    } else {
+        ZSTD_DCtx_reset(PHP_ZSTD_G(dctx), ZSTD_reset_session_and_parameters);
+    }
+    return PHP_ZSTD_G(dctx);
+}
+
+/* Serialized value compressed in a single frame, NULL on error */
+static zend_string *php_zstd_serialize(zval *value, int level,
+                                       ZSTD_CDict *cdict)
+{
+    php_serialize_data_t var_hash;
+    smart_str local = {0}, *var;
+    ZSTD_CCtx *cctx;
+    ZSTD_inBuffer in;
+    ZSTD_outBuffer out;
+    zend_string *output = NULL;
+    size_t result;
+
+    /* Nested calls, from __serialize() or __sleep(), get their own buffer */
+    if (PHP_ZSTD_G(serialize_busy)) {
+        var = &local;
+    } else {
+        var = &PHP_ZSTD_G(serialize_buf);
+        if (var->s) {
+            ZSTR_LEN(var->s) = 0;
+        }
+        PHP_ZSTD_G(serialize_busy) = 1;
+    }
+
+    PHP_VAR_SERIALIZE_INIT(var_hash);
+    php_var_serialize(var, value, &var_hash);
+    PHP_VAR_SERIALIZE_DESTROY(var_hash);
+    if (EG(exception) || var->s == NULL) {
+        goto done;
+    }
+
+    cctx = php_zstd_serialize_cctx();
+    if (cctx == NULL) {
+        ZSTD_WARNING("ZSTD_createCCtx() error");
+        goto done;
+    }
+    if (cdict) {
+        ZSTD_CCtx_refCDict(cctx, cdict);
+    } else {
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+    }
+
+    in.src = ZSTR_VAL(var->s);
+    in.size = ZSTR_LEN(var->s);
+    in.pos = 0;
+
+    /* Serialized data compresses well, grow the output when needed
+     * rather than allocating ZSTD_compressBound() upfront */
+    out.size = in.size / 4 + 64;
+    output = zend_string_alloc(out.size, 0);
+    out.dst = ZSTR_VAL(output);
+    out.pos = 0;
+
+    while (1) {
+        result = ZSTD_compressStream2(cctx, &out, &in, ZSTD_e_end);
+        if (ZSTD_IS_ERROR(result)) {
+            ZSTD_WARNING("%s", ZSTD_getErrorName(result));
+            zend_string_efree(output);
+            output = NULL;
+            goto done;
+        }
+        if (result == 0) {
+            break;
+        }
+        out.size += MAX(result, out.size / 2);
+        output = zend_string_extend(output, out.size, 0);
+        out.dst = ZSTR_VAL(output);
+    }
+
+    output = zstd_string_output_truncate(output, out.pos);
+
+done:
+    if (var == &local) {
+        smart_str_free(&local);
+    } else {
+        if (var->a > ZSTD_SCRATCH_MAX) {
+            smart_str_free(var);
+        }
+        PHP_ZSTD_G(serialize_busy) = 0;
+    }
+
+    return output;
+}
+
+static void php_zstd_var_unserialize(zval *return_value,
+                                     const char *buf, size_t buf_len,
+                                     HashTable *options)
+{
+#if PHP_VERSION_ID >= 80000
+    php_unserialize_with_options(return_value, buf, buf_len, options,
+                                 "zstd_unserialize");
+#else
+    const unsigned char *p = (const unsigned char *) buf;
+    php_unserialize_data_t var_hash;
+
+    if (buf_len == 0) {
+        RETURN_FALSE;
+    }
+
+    PHP_VAR_UNSERIALIZE_INIT(var_hash);
+    if (!php_var_unserialize(return_value, &p, p + buf_len, &var_hash)) {
+        if (!EG(exception)) {
+            php_error_docref(NULL, E_NOTICE,
+                             "Error at offset %ld of %ld bytes",
+                             (long) ((char *) p - buf), (long) buf_len);
+        }
+        zval_ptr_dtor(return_value);
+        ZVAL_FALSE(return_value);
+    }
+    PHP_VAR_UNSERIALIZE_DESTROY(var_hash);
+#endif
+}
+
+static void php_zstd_unserialize(zval *return_value,
+                                 const char *input, size_t input_len,
+                                 HashTable *options)
+{
+    uint64_t size;
+    size_t result;
+    char *buf;
+    int scratch = 0;
+    php_zstd_dict *dict;
+    ZSTD_DCtx *dctx;
+    zend_string *output;
+
+    size = ZSTD_getFrameContentSize(input, input_len);
+    if (size == ZSTD_CONTENTSIZE_ERROR) {
+        ZSTD_WARNING("it was not compressed by zstd");
+        RETURN_FALSE;
+    }
+    if (size == ZSTD_CONTENTSIZE_UNKNOWN || size > ZSTR_MAX_LEN
+        || ZSTD_findFrameCompressedSize(input, input_len) != input_len) {
+        /* Not written by zstd_serialize, decode it as a whole, with the
+         * dictionaries of all its frames */
+        output = php_zstd_uncompress(input, input_len);
+        if (output == NULL) {
+            RETURN_FALSE;
+        }
+        php_zstd_var_unserialize(return_value,
+                                 ZSTR_VAL(output), ZSTR_LEN(output), options);
+        zend_string_efree(output);
+        return;
+    }
+
+    dctx = php_zstd_serialize_dctx();
+    if (dctx == NULL) {
+        ZSTD_WARNING("ZSTD_createDCtx() error");
+        RETURN_FALSE;
+    }
+
+    /* Nested calls, from __unserialize() or __wakeup(), get their own
+     * buffer. A bailout from them leaves the scratch buffer busy until
+     * RSHUTDOWN */
+    buf = php_zstd_scratch_acquire(size);
+    if (buf) {
+        scratch = 1;
+    } else {
+        buf = emalloc(size ? size : 1);
+    }
+
+    dict = php_zstd_dict_find_id(ZSTD_getDictID_fromFrame(input, input_len));
+    if (dict) {
+        result = ZSTD_decompress_usingDDict(dctx, buf, size,
+                                            input, input_len, dict->ddict);
+    } else {
+        result = ZSTD_decompressDCtx(dctx, buf, size, input, input_len);
+    }
+
+    if (ZSTD_IS_ERROR(result)) {
+        ZSTD_WARNING("%s", ZSTD_getErrorName(result));
+        ZVAL_FALSE(return_value);
+    } else {
+        php_zstd_var_unserialize(return_value, buf, result, options);
+    }
+
+    if (scratch) {
+        php_zstd_scratch_release();
+    } else {
+        efree(buf);
+    }
+}
+
+ZEND_FUNCTION(zstd_serialize)
+{
+    zval *value;
+    zend_long level = DEFAULT_COMPRESS_LEVEL;
+    char *dict = NULL;
+    size_t dict_len = 0;
+    ZSTD_CDict *cdict = NULL;
+    int cdict_owned = 0;
+    zend_string *output;
+
+    ZEND_PARSE_PARAMETERS_START(1, 3)
+        Z_PARAM_ZVAL(value)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_LONG(level)
+        Z_PARAM_STRING_EX(dict, dict_len, 1, 0)
+    ZEND_PARSE_PARAMETERS_END();
+
+    if (!zstd_check_compress_level(level)) {
+        RETURN_FALSE;
+    }
+
+    if (dict) {
+        cdict = php_zstd_cdict(dict, dict_len, (int) level, &cdict_owned);
+        if (!cdict) {
+            ZSTD_WARNING("ZSTD_createCDict() error");
+            RETURN_FALSE;
+        }
+    }
+
+    output = php_zstd_serialize(value, (int) level, cdict);
+
+    if (cdict_owned) {
+        ZSTD_freeCDict(cdict);
+    }
+
+    if (output == NULL) {
+        RETURN_FALSE;
+    }
+    RETURN_NEW_STR(output);
+}
+
+ZEND_FUNCTION(zstd_unserialize)
+{
+    char *input;
+    size_t input_len;
+    HashTable *options = NULL;
+
+    ZEND_PARSE_PARAMETERS_START(1, 2)
+        Z_PARAM_STRING(input, input_len)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_ARRAY_HT(options)
+    ZEND_PARSE_PARAMETERS_END();
+
+    php_zstd_unserialize(return_value, input, input_len, options);
+}
+#endif
+
+ZEND_FUNCTION(zstd_stats)
+{
+    if (zend_parse_parameters_none() == FAILURE) {
+        return;
+    }
+
+    array_init(return_value);
+    add_assoc_long(return_value, "compress_calls",
+                   (zend_long) PHP_ZSTD_G(stats).compress_calls);
+    add_assoc_long(return_value, "bytes_in",
+                   (zend_long) PHP_ZSTD_G(stats).bytes_in);
+    add_assoc_long(return_value, "bytes_out",
+                   (zend_long) PHP_ZSTD_G(stats).bytes_out);
+    add_assoc_long(return_value, "incompressible",
+                   (zend_long) PHP_ZSTD_G(stats).incompressible);
+    add_assoc_long(return_value, "incompressible_bytes",
+                   (zend_long) PHP_ZSTD_G(stats).incompressible_bytes);
+    add_assoc_long(return_value, "cache_hits",
+                   (zend_long) PHP_ZSTD_G(stats).cache_hits);
+    add_assoc_long(return_value, "cache_misses",
+                   (zend_long) PHP_ZSTD_G(stats).cache_misses);
+    add_assoc_long(return_value, "cache_entries",
+                   (zend_long) PHP_ZSTD_G(memo_count));
+    add_assoc_long(return_value, "cache_bytes",
+                   (zend_long) PHP_ZSTD_G(memo_bytes));
+}
+
+
+typedef struct _php_zstd_stream_data {
+    char *bufin, *bufout;
+    size_t sizein, sizeout;
+    ZSTD_CCtx* cctx;
+    ZSTD_DCtx* dctx;
+    ZSTD_inBuffer input;
+    ZSTD_outBuffer output;
+    php_stream *stream;
+#if ZSTD_VERSION_NUMBER >= 10400
+    ZSTD_CDict *cdict;
+    ZSTD_DDict *ddict;
+    int level;
+    int adapt, min_level, max_level;
+    size_t adapt_size;
+    double comp_time, write_time;
+    int detect, stored;
+    size_t frame_size;
+#endif
+    int dict_lookup;
+    int mapped;
+    int pending;
+} php_zstd_stream_data;
+
+
+// Free the dictionaries owned by the stream, preloaded ones are shared
+static void php_zstd_stream_dict_free(php_zstd_stream_data *self)
+{
+#if ZSTD_VERSION_NUMBER >= 10400
+    ZSTD_freeCDict(self->cdict);
+    ZSTD_freeDDict(self->ddict);
+    self->cdict = NULL;
+    self->ddict = NULL;
+#endif
+}
+
+#define STREAM_DATA_FROM_STREAM() \
+    php_zstd_stream_data *self = (php_zstd_stream_data *) stream->abstract
+
+#define STREAM_NAME "compress.zstd"
+
+static int php_zstd_decomp_close(php_stream *stream, int close_handle)
+{
+    STREAM_DATA_FROM_STREAM();
+
+    if (!self) {
+        return EOF;
+    }
+
+    if (self->mapped) {
+        php_stream_mmap_unmap(self->stream);
+    }
+
+    if (close_handle) {
+        if (self->stream) {
+            php_stream_close(self->stream);
+            self->stream = NULL;
+        }
+    }
+
+    ZSTD_freeDCtx(self->dctx);
+    php_zstd_stream_dict_free(self);
+    if (self->bufin) {
+        efree(self->bufin);
+    }
+    efree(self->bufout);
+    efree(self);
+    stream->abstract = NULL;
+
+    return EOF;
+}
+
+#if ZSTD_VERSION_NUMBER < 10400
+static int php_zstd_comp_flush_or_end(php_zstd_stream_data *self, int end)
+{
+    size_t res;
+    int ret = 0;
+
+    /* Compress remaining data */
+    if (self->input.size)  {
+        self->input.pos = 0;
+        do {
+            self->output.size = self->sizeout;
+            self->output.pos  = 0;
+            res = ZSTD_compressStream(self->cctx, &self->output, &self->input);
+            if (ZSTD_IS_ERROR(res)) {
+                php_error_docref(NULL, E_WARNING, "libzstd error %s\n", ZSTD_getErrorName(res));
+                ret = EOF;
+                break;
+            }
+            php_stream_write(self->stream, self->bufout, self->output.pos);
+        } while (self->input.pos != self->input.size);
+    }
+
+    /* Flush / End */
+    do {
+        self->output.size = self->sizeout;
+        self->output.pos  = 0;
+
+        if (end) {
+            res = ZSTD_endStream(self->cctx, &self->output);
+        } else {
+            res = ZSTD_flushStream(self->cctx, &self->output);
+        }
+        if (ZSTD_IS_ERROR(res)) {
+            php_error_docref(NULL, E_WARNING, "libzstd error %s\n", ZSTD_getErrorName(res));
+            ret = EOF;
+            break;
+        }
+        php_stream_write(self->stream, self->bufout, self->output.pos);
+    } while (res > 0);
+
+    self->input.pos = 0;
+    self->input.size = 0;
+
+    return ret;
+}
+
+#else
+static int php_zstd_comp_flush_or_end(php_zstd_stream_data *self, int end)
+{
+    size_t res;
+    int ret = 0;
+
+    ZSTD_inBuffer in = { NULL, 0, 0 };
+
+    /* Flush / End */
+    do {
+        self->output.pos  = 0;
+        res = ZSTD_compressStream2(self->cctx, &self->output, &in, end ? ZSTD_e_end : ZSTD_e_flush);
+        if (ZSTD_isError(res)) {
+            php_error_docref(NULL, E_WARNING, "libzstd error %s\n", ZSTD_getErrorName(res));
+            ret = EOF;
+            break;
+        }
+        php_stream_write(self->stream, self->output.dst, self->output.pos);
+    } while (res > 0);
+
+    if (end) {
+        self->frame_size = 0;
+    }
+
+    return ret;
+}
+#endif
+
+
+#if ZSTD_VERSION_NUMBER >= 10400
+/* Amount of input between two decisions of the adaptive level */
+#define ZSTD_ADAPT_SIZE (1024 * 1024)
+
+static double php_zstd_time(void)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1000000000.0;
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1000000.0;
+#endif
+}
+
+/* Raise the level while writing to the inner stream dominates, lower it
+ * while compressing does. A frame is ended to apply a new level. */
+static void php_zstd_comp_adapt(php_zstd_stream_data *self)
+{
+    int level = self->level;
+
+    if (self->write_time > self->comp_time) {
+        if (level < self->max_level) {
+            level++;
+        }
+    } else if (self->comp_time > self->write_time * 2) {
+        if (level > self->min_level) {
+            level--;
+        }
+    }
+
+    if (level != self->level) {
+        php_zstd_comp_flush_or_end(self, 1);
+        ZSTD_CCtx_setParameter(self->cctx, ZSTD_c_compressionLevel, level);
+        self->level = level;
+    }
+
+    self->adapt_size = 0;
+    self->comp_time = 0;
+    self->write_time = 0;
+}
+
+/* Slice of input stored by each frame of incompressible writes */
+#define ZSTD_STORED_FRAME_MAX (1024 * 1024)
+
+/* Write incompressible data as stored frames, ending the current one */
+static size_t php_zstd_comp_write_stored(php_zstd_stream_data *self,
+                                         const char *buf, size_t count)
+{
+    char *frame;
+    size_t slice, size, left = count;
+
+    if (self->frame_size) {
+        php_zstd_comp_flush_or_end(self, 1);
+    }
+
+    frame = emalloc(php_zstd_stored_bound(MIN(count, ZSTD_STORED_FRAME_MAX)));
+    while (left > 0) {
+        slice = MIN(left, ZSTD_STORED_FRAME_MAX);
+        size = php_zstd_stored_frame(frame, buf, slice, 1);
+        php_stream_write(self->stream, frame, size);
+        buf += slice;
+        left -= slice;
+    }
+    efree(frame);
+
+    self->stored = 1;
+    PHP_ZSTD_G(stats).incompressible++;
+    PHP_ZSTD_G(stats).incompressible_bytes += count;
+
+    return count;
+}
+#endif
+
+static int php_zstd_comp_flush(php_stream *stream)
+{
+    STREAM_DATA_FROM_STREAM();
+
+    return php_zstd_comp_flush_or_end(self, 0);
+}
+
+
+static int php_zstd_comp_close(php_stream *stream, int close_handle)
+{
+    STREAM_DATA_FROM_STREAM();
+
+    if (!self) {
+        return EOF;
+    }
+
+#if ZSTD_VERSION_NUMBER >= 10400
+    /* No empty frame after stored ones */
+    if (self->frame_size || !self->stored)
+#endif
+    php_zstd_comp_flush_or_end(self, 1);
+
+    if (close_handle) {
+        if (self->stream) {
+            php_stream_close(self->stream);
+            self->stream = NULL;
+        }
+    }
+
+    ZSTD_freeCCtx(self->cctx);
+    php_zstd_stream_dict_free(self);
+#if ZSTD_VERSION_NUMBER >= 10400
+    efree(self->output.dst);
+#else
+    efree(self->bufin);
+    efree(self->bufout);
+#endif
+    efree(self);
+    stream->abstract = NULL;
+
+    return EOF;
+}
+
+
+#if PHP_VERSION_ID < 70400
+static size_t php_zstd_decomp_read(php_stream *stream, char *buf, size_t count)
 {
     size_t ret = 0;
 #else
@@ -556,296 +3280,1236 @@ static ssize_t php_zstd_decomp_read(php_stream *stream, char *buf, size_t count)
             buf += x;
             count -= x;
         }
-        /* decompress */
-        if (self->input.pos < self->input.size) {
-            /* for zstd */
-            self->output.pos = 0;
+        /* decompress */
+        if (self->input.pos < self->input.size || self->pending) {
+            /* for zstd */
+            self->output.pos = 0;
+            self->output.size = self->sizeout;
+            res = ZSTD_decompressStream(self->dctx, &self->output , &self->input);
+            if (ZSTD_IS_ERROR(res)) {
+                php_error_docref(NULL, E_WARNING, "libzstd error %s\n", ZSTD_getErrorName(res));
+#if PHP_VERSION_ID >= 70400
+                return -1;
+#endif
+            }
+            /* The context may still hold output once the input is
+             * consumed, flush it until a call makes no progress */
+            self->pending = !ZSTD_IS_ERROR(res) && res != 0
+                            && self->output.pos > 0;
+            /* for us */
+            self->output.size = self->output.pos;
+            self->output.pos = 0;
+        } else if (self->mapped) {
+            /* EOF */
+            count = 0;
+        } else {
+            /* read */
+            self->input.pos = 0;
+            self->input.size = php_stream_read(self->stream, self->bufin, self->sizein);
+            if (!self->input.size) {
+                /* EOF */
+                count = 0;
+            } else if (self->dict_lookup) {
+                self->dict_lookup = 0;
+                php_zstd_dctx_ref_dicts(self->dctx,
+                                        self->bufin, self->input.size);
+            }
+        }
+    }
+    return ret;
+}
+
+
+#if PHP_VERSION_ID < 70400
+static size_t php_zstd_comp_write(php_stream *stream, const char *buf, size_t count)
+{
+#else
+static ssize_t php_zstd_comp_write(php_stream *stream, const char *buf, size_t count)
+{
+#endif
+
+    STREAM_DATA_FROM_STREAM();
+
+#if ZSTD_VERSION_NUMBER >= 10400
+    size_t res;
+    double start = 0, end = 0;
+    ZSTD_inBuffer in = { buf, count, 0 };
+
+    if (self->detect && php_zstd_incompressible(buf, count)) {
+        return php_zstd_comp_write_stored(self, buf, count);
+    }
+    self->frame_size += count;
+
+    do {
+        self->output.pos = 0;
+        if (self->adapt) {
+            start = php_zstd_time();
+        }
+        res = ZSTD_compressStream2(self->cctx, &self->output, &in, ZSTD_e_continue);
+        if (ZSTD_isError(res)) {
+            php_error_docref(NULL, E_WARNING, "libzstd error %s\n", ZSTD_getErrorName(res));
+#if PHP_VERSION_ID >= 70400
+            return -1;
+#endif
+        }
+        if (self->adapt) {
+            end = php_zstd_time();
+            self->comp_time += end - start;
+        }
+        php_stream_write(self->stream, self->output.dst, self->output.pos);
+        if (self->adapt) {
+            self->write_time += php_zstd_time() - end;
+        }
+
+    } while (res > 0);
+
+    if (self->adapt) {
+        self->adapt_size += count;
+        if (self->adapt_size >= ZSTD_ADAPT_SIZE) {
+            php_zstd_comp_adapt(self);
+        }
+    }
+
+    return count;
+
+#else
+    size_t ret = 0;
+    size_t x, res;
+
+    while(count > 0) {
+        /* enough room for full data */
+        if (self->input.size + count < self->sizein) {
+            memcpy(self->bufin + self->input.size, buf, count);
+            self->input.size += count;
+            ret += count;
+            count = 0;
+            break;
+        }
+
+        /* fill input buffer */
+        x = self->sizein - self->input.size;
+        memcpy(self->bufin + self->input.size, buf, x);
+        self->input.size += x;
+        buf += x;
+        count -= x;
+        ret += x;
+
+        /* compress and write */
+        self->input.pos = 0;
+        do {
             self->output.size = self->sizeout;
-            res = ZSTD_decompressStream(self->dctx, &self->output , &self->input);
+            self->output.pos  = 0;
+            res = ZSTD_compressStream(self->cctx, &self->output, &self->input);
             if (ZSTD_IS_ERROR(res)) {
                 php_error_docref(NULL, E_WARNING, "libzstd error %s\n", ZSTD_getErrorName(res));
 #if PHP_VERSION_ID >= 70400
                 return -1;
 #endif
             }
-            /* for us */
-            self->output.size = self->output.pos;
-            self->output.pos = 0;
-        }  else {
-            /* read */
-            self->input.pos = 0;
-            self->input.size = php_stream_read(self->stream, self->bufin, self->sizein);
-            if (!self->input.size) {
-                /* EOF */
-                count = 0;
+            php_stream_write(self->stream, self->bufout, self->output.pos);
+        } while (self->input.pos != self->input.size);
+
+        self->input.pos = 0;
+        self->input.size = 0;
+    }
+    return ret;
+#endif
+}
+
+
+static php_stream_ops php_stream_zstd_read_ops = {
+    NULL,    /* write */
+    php_zstd_decomp_read,
+    php_zstd_decomp_close,
+    NULL,    /* flush */
+    STREAM_NAME,
+    NULL,    /* seek */
+    NULL,    /* cast */
+    NULL,    /* stat */
+    NULL     /* set_option */
+};
+
+
+static php_stream_ops php_stream_zstd_write_ops = {
+    php_zstd_comp_write,
+    NULL,    /* read */
+    php_zstd_comp_close,
+    php_zstd_comp_flush,
+    STREAM_NAME,
+    NULL,    /* seek */
+    NULL,    /* cast */
+    NULL,    /* stat */
+    NULL     /* set_option */
+};
+
+
+static php_stream *
+php_stream_zstd_opener(
+    php_stream_wrapper *wrapper,
+    const char *path,
+    const char *mode,
+    int options,
+    zend_string **opened_path,
+    php_stream_context *context
+    STREAMS_DC)
+{
+    php_zstd_stream_data *self;
+    int level = ZSTD_CLEVEL_DEFAULT;
+    int compress;
+    unsigned long long pledged_size = ZSTD_CONTENTSIZE_UNKNOWN;
+    char *map;
+    size_t map_len = 0;
+#if ZSTD_VERSION_NUMBER >= 10400
+    ZSTD_CDict *cdict = NULL;
+    ZSTD_DDict *ddict = NULL;
+    int dict_owned = 0;
+    int adapt = 0, min_level = 1, max_level = ZSTD_maxCLevel();
+    int detect = 0, checksum = 0;
+#endif
+
+    if (strncasecmp(STREAM_NAME, path, sizeof(STREAM_NAME)-1) == 0) {
+        path += sizeof(STREAM_NAME)-1;
+        if (strncmp("://", path, 3) == 0) {
+            path += 3;
+        }
+    }
+
+    if (php_check_open_basedir(path)) {
+        return NULL;
+    }
+
+    if (!strcmp(mode, "w") || !strcmp(mode, "wb") || !strcmp(mode, "a") || !strcmp(mode, "ab")) {
+       compress = 1;
+    } else if (!strcmp(mode, "r") || !strcmp(mode, "rb")) {
+       compress = 0;
+    } else {
+        php_error_docref(NULL, E_ERROR, "zstd: invalid open mode");
+        return NULL;
+    }
+
+    if (context) {
+        zval *tmpzval;
+        zend_string *data;
+
+        if (NULL != (tmpzval = php_stream_context_get_option(context, "zstd", "level"))) {
+            level = zval_get_long(tmpzval);
+        }
+        if (NULL != (tmpzval = php_stream_context_get_option(context, "zstd", "size"))) {
+            zend_long size = zval_get_long(tmpzval);
+            if (size < 0) {
+                php_error_docref(NULL, E_WARNING, "zstd: pledged size (" ZEND_LONG_FMT ") must be 0 or greater", size);
+            } else {
+                pledged_size = (unsigned long long) size;
+            }
+        }
+#if ZSTD_VERSION_NUMBER >= 10400
+        if (NULL != (tmpzval = php_stream_context_get_option(context, "zstd", "adapt"))) {
+            adapt = zend_is_true(tmpzval);
+        }
+        if (NULL != (tmpzval = php_stream_context_get_option(context, "zstd", "detect"))) {
+            detect = zend_is_true(tmpzval);
+        }
+        if (NULL != (tmpzval = php_stream_context_get_option(context, "zstd", "checksum"))) {
+            checksum = zend_is_true(tmpzval);
+        }
+        if (NULL != (tmpzval = php_stream_context_get_option(context, "zstd", "min_level"))) {
+            min_level = zval_get_long(tmpzval);
+        }
+        if (NULL != (tmpzval = php_stream_context_get_option(context, "zstd", "max_level"))) {
+            max_level = zval_get_long(tmpzval);
+        }
+        if (NULL != (tmpzval = php_stream_context_get_option(context, "zstd", "dict"))) {
+            data = zval_get_string(tmpzval);
+            if (compress) {
+                cdict = php_zstd_cdict(ZSTR_VAL(data), ZSTR_LEN(data), level, &dict_owned);
+            } else {
+                ddict = php_zstd_ddict(ZSTR_VAL(data), ZSTR_LEN(data), &dict_owned);
+            }
+            zend_string_release(data);
+        }
+#endif
+    }
+
+    if (level > ZSTD_maxCLevel()) {
+        php_error_docref(NULL, E_WARNING, "zstd: compression level (%d) must be less than %d", level, ZSTD_maxCLevel());
+        level = ZSTD_maxCLevel();
+    }
+
+#if ZSTD_VERSION_NUMBER >= 10400
+    if (compress && detect && pledged_size != ZSTD_CONTENTSIZE_UNKNOWN) {
+        php_error_docref(NULL, E_WARNING, "zstd: detect can not be used with a pledged size");
+        detect = 0;
+    }
+    if (compress && adapt) {
+        if (pledged_size != ZSTD_CONTENTSIZE_UNKNOWN) {
+            php_error_docref(NULL, E_WARNING, "zstd: adapt can not be used with a pledged size");
+            adapt = 0;
+        }
+        /* The level of a referenced dictionary wins over the adapted one */
+        if (cdict) {
+            php_error_docref(NULL, E_WARNING, "zstd: adapt can not be used with dict");
+            adapt = 0;
+        }
+        if (max_level > ZSTD_maxCLevel()) {
+            max_level = ZSTD_maxCLevel();
+        }
+        if (min_level > max_level) {
+            php_error_docref(NULL, E_WARNING, "zstd: min_level (%d) must be less than max_level (%d)", min_level, max_level);
+            min_level = max_level;
+        }
+        if (level < min_level) {
+            level = min_level;
+        } else if (level > max_level) {
+            level = max_level;
+        }
+    }
+#endif
+
+    self = ecalloc(sizeof(*self), 1);
+#if ZSTD_VERSION_NUMBER >= 10400
+    if (dict_owned) {
+        self->cdict = cdict;
+        self->ddict = ddict;
+    }
+#endif
+    self->stream = php_stream_open_wrapper(path, mode, options | REPORT_ERRORS, NULL);
+    if (!self->stream) {
+        php_zstd_stream_dict_free(self);
+        efree(self);
+        return NULL;
+    }
+
+    /* File */
+    if (compress) {
+        self->dctx = NULL;
+        self->cctx = ZSTD_createCCtx();
+        if (!self->cctx) {
+            php_error_docref(NULL, E_WARNING, "zstd: compression context failed");
+            php_stream_close(self->stream);
+            php_zstd_stream_dict_free(self);
+            efree(self);
+            return NULL;
+        }
+#if ZSTD_VERSION_NUMBER >= 10400
+        ZSTD_CCtx_reset(self->cctx, ZSTD_reset_session_only);
+        ZSTD_CCtx_refCDict(self->cctx, cdict);
+        ZSTD_CCtx_setParameter(self->cctx, ZSTD_c_compressionLevel, level);
+        ZSTD_CCtx_setParameter(self->cctx, ZSTD_c_checksumFlag, checksum);
+        self->level = level;
+        self->adapt = adapt;
+        self->min_level = min_level;
+        self->max_level = max_level;
+        /* Stored frames have no checksum */
+        self->detect = detect && !checksum;
+        if (pledged_size != ZSTD_CONTENTSIZE_UNKNOWN) {
+            ZSTD_CCtx_setPledgedSrcSize(self->cctx, pledged_size);
+        }
+
+        self->output.size = ZSTD_CStreamOutSize();
+        self->output.dst  = emalloc(self->output.size);
+        self->output.pos  = 0;
+
+#else
+        if (pledged_size == 0) {
+            /* ZSTD_initCStream_srcSize() takes 0 as an unknown size,
+             * the content size flag makes it an empty content */
+            ZSTD_parameters params = ZSTD_getParams(level, 0, 0);
+            params.fParams.contentSizeFlag = 1;
+            ZSTD_initCStream_advanced(self->cctx, NULL, 0, params, 0);
+        } else if (pledged_size != ZSTD_CONTENTSIZE_UNKNOWN) {
+            ZSTD_initCStream_srcSize(self->cctx, level, pledged_size);
+        } else {
+            ZSTD_initCStream(self->cctx, level);
+        }
+
+        self->bufin = emalloc(self->sizein = ZSTD_CStreamInSize());
+        self->bufout = emalloc(self->sizeout = ZSTD_CStreamOutSize());
+        self->input.src  = self->bufin;
+        self->input.pos   = 0;
+        self->input.size  = 0;
+        self->output.dst = self->bufout;
+        self->output.pos  = 0;
+        self->output.size = 0;
+#endif
+
+        return php_stream_alloc(&php_stream_zstd_write_ops, self, NULL, mode);
+
+    } else {
+        self->dctx = ZSTD_createDCtx();
+        if (!self->dctx) {
+            php_error_docref(NULL, E_WARNING, "zstd: compression context failed");
+            php_stream_close(self->stream);
+            php_zstd_stream_dict_free(self);
+            efree(self);
+            return NULL;
+        }
+        self->cctx = NULL;
+        self->bufout = emalloc(self->sizeout = ZSTD_DStreamOutSize());
+#if ZSTD_VERSION_NUMBER >= 10400
+        ZSTD_DCtx_reset(self->dctx, ZSTD_reset_session_only);
+        ZSTD_DCtx_refDDict(self->dctx, ddict);
+        self->dict_lookup = (ddict == NULL);
+#else
+        ZSTD_initDStream(self->dctx);
+        self->dict_lookup = 1;
+#endif
+        self->input.pos   = 0;
+
+        /* Local files are mapped and given to libzstd as a single input
+         * buffer, other streams are read by ZSTD_DStreamInSize() bytes */
+        map = php_stream_mmap_range(self->stream, 0, PHP_STREAM_MMAP_ALL,
+                                    PHP_STREAM_MAP_MODE_SHARED_READONLY,
+                                    &map_len);
+        if (map) {
+#if defined(HAVE_SYS_MMAN_H) && defined(MADV_SEQUENTIAL)
+            madvise(map, map_len, MADV_SEQUENTIAL);
+#endif
+            self->mapped = 1;
+            self->input.src  = map;
+            self->input.size = map_len;
+            if (self->dict_lookup) {
+                self->dict_lookup = 0;
+                php_zstd_dctx_ref_dicts(self->dctx, map, map_len);
             }
+        } else {
+            self->bufin = emalloc(self->sizein = ZSTD_DStreamInSize());
+            self->input.src  = self->bufin;
+            self->input.size = 0;
+        }
+        self->output.dst  = self->bufout;
+        self->output.pos  = 0;
+        self->output.size = 0;
+
+        return php_stream_alloc(&php_stream_zstd_read_ops, self, NULL, mode);
+    }
+}
+
+
+static php_stream_wrapper_ops zstd_stream_wops = {
+    php_stream_zstd_opener,
+    NULL,    /* close */
+    NULL,    /* fstat */
+    NULL,    /* stat */
+    NULL,    /* opendir */
+    STREAM_NAME,
+    NULL,    /* unlink */
+    NULL,    /* rename */
+    NULL,    /* mkdir */
+    NULL,    /* rmdir */
+    NULL
+};
+
+
+php_stream_wrapper php_stream_zstd_wrapper = {
+    &zstd_stream_wops,
+    NULL,
+    0 /* is_url */
+};
+
+#if ZSTD_VERSION_NUMBER >= 10400
+#define ZSTD_FILE_BUFFER_SIZE (1024 * 1024)
+
+static php_stream *zstd_file_open(const char *path, const char *mode)
+{
+    if (php_check_open_basedir(path)) {
+        return NULL;
+    }
+    return php_stream_open_wrapper(path, mode, REPORT_ERRORS, NULL);
+}
+
+static int zstd_file_options(HashTable *options,
+                             zend_long *level, zend_string **dict)
+{
+    zval *tmpzval;
+
+    if (options == NULL) {
+        return 1;
+    }
+    if (level
+        && NULL != (tmpzval = zend_hash_str_find(options, ZEND_STRL("level")))) {
+        *level = zval_get_long(tmpzval);
+        if (!zstd_check_compress_level(*level)) {
+            return 0;
         }
     }
-    return ret;
+    if (NULL != (tmpzval = zend_hash_str_find(options, ZEND_STRL("dict")))) {
+        *dict = zval_get_string(tmpzval);
+    }
+    return 1;
 }
 
-
-#if PHP_VERSION_ID < 70400
-static size_t php_zstd_comp_write(php_stream *stream, const char *buf, size_t count)
-{
-#else
-static ssize_t php_zstd_comp_write(php_stream *stream, const char *buf, size_t count)
+/* Feed the whole mapped source (or buffered reads when it can not be
+ * mapped) to the compressor, returns the number of bytes written */
+static zend_long zstd_file_compress(php_stream *src, php_stream *dst,
+                                    ZSTD_CCtx *cctx)
 {
-#endif
-
-    STREAM_DATA_FROM_STREAM();
+    ZSTD_inBuffer in = { NULL, 0, 0 };
+    ZSTD_outBuffer out = { NULL, 0, 0 };
+    ZSTD_EndDirective mode;
+    char *map, *buf = NULL;
+    size_t map_len = 0, res;
+    zend_long written = 0;
+
+    map = php_stream_mmap_range(src, 0, PHP_STREAM_MMAP_ALL,
+                                PHP_STREAM_MAP_MODE_SHARED_READONLY, &map_len);
+    if (map) {
+        ZSTD_CCtx_setPledgedSrcSize(cctx, map_len);
+        in.src = map;
+        in.size = map_len;
+    } else {
+        buf = emalloc(ZSTD_FILE_BUFFER_SIZE);
+    }
 
-#if ZSTD_VERSION_NUMBER >= 10400
-    size_t res;
-    ZSTD_inBuffer in = { buf, count, 0 };
+    out.dst = emalloc(out.size = ZSTD_FILE_BUFFER_SIZE);
 
     do {
-        self->output.pos = 0;
-        res = ZSTD_compressStream2(self->cctx, &self->output, &in, ZSTD_e_continue);
-        if (ZSTD_isError(res)) {
-            php_error_docref(NULL, E_WARNING, "libzstd error %s\n", ZSTD_getErrorName(res));
-#if PHP_VERSION_ID >= 70400
-            return -1;
-#endif
+        if (!map) {
+            in.size = php_stream_read(src, buf, ZSTD_FILE_BUFFER_SIZE);
+            if ((ssize_t) in.size < 0) {
+                ZSTD_WARNING("can not read source file");
+                written = -1;
+                break;
+            }
+            in.src = buf;
+            in.pos = 0;
         }
-        php_stream_write(self->stream, self->output.dst, self->output.pos);
+        mode = (map || in.size == 0) ? ZSTD_e_end : ZSTD_e_continue;
 
-    } while (res > 0);
+        do {
+            out.pos = 0;
+            res = ZSTD_compressStream2(cctx, &out, &in, mode);
+            if (ZSTD_IS_ERROR(res)) {
+                ZSTD_WARNING("%s", ZSTD_getErrorName(res));
+                written = -1;
+                break;
+            }
+            if (out.pos
+                && (size_t) php_stream_write(dst, out.dst, out.pos) != out.pos) {
+                ZSTD_WARNING("can not write destination file");
+                written = -1;
+                break;
+            }
+            written += out.pos;
+        } while (mode == ZSTD_e_end ? res > 0 : in.pos < in.size);
+    } while (written >= 0 && mode != ZSTD_e_end);
 
-    return count;
+    if (map) {
+        php_stream_mmap_unmap(src);
+    } else {
+        efree(buf);
+    }
+    efree(out.dst);
 
-#else
-    size_t ret = 0;
-    size_t x, res;
+    return written;
+}
 
-    while(count > 0) {
-        /* enough room for full data */
-        if (self->input.size + count < self->sizein) {
-            memcpy(self->bufin + self->input.size, buf, count);
-            self->input.size += count;
-            ret += count;
-            count = 0;
-            break;
+static zend_long zstd_file_uncompress(php_stream *src, php_stream *dst,
+                                      ZSTD_DCtx *dctx, int dict_lookup)
+{
+    ZSTD_inBuffer in = { NULL, 0, 0 };
+    ZSTD_outBuffer out = { NULL, 0, 0 };
+    char *map, *buf = NULL;
+    size_t map_len = 0, res = 0;
+    zend_long written = 0;
+    int empty = 1;
+
+    map = php_stream_mmap_range(src, 0, PHP_STREAM_MMAP_ALL,
+                                PHP_STREAM_MAP_MODE_SHARED_READONLY, &map_len);
+    if (map) {
+        in.src = map;
+        in.size = map_len;
+    } else {
+        buf = emalloc(ZSTD_FILE_BUFFER_SIZE);
+    }
+
+    out.dst = emalloc(out.size = ZSTD_FILE_BUFFER_SIZE);
+
+    do {
+        if (!map) {
+            in.size = php_stream_read(src, buf, ZSTD_FILE_BUFFER_SIZE);
+            if ((ssize_t) in.size < 0) {
+                ZSTD_WARNING("can not read source file");
+                written = -1;
+                break;
+            }
+            if (in.size == 0) {
+                break;
+            }
+            in.src = buf;
+            in.pos = 0;
+        }
+        if (in.size > 0) {
+            empty = 0;
         }
 
-        /* fill input buffer */
-        x = self->sizein - self->input.size;
-        memcpy(self->bufin + self->input.size, buf, x);
-        self->input.size += x;
-        buf += x;
-        count -= x;
-        ret += x;
+        if (dict_lookup) {
+            dict_lookup = 0;
+            php_zstd_dctx_ref_dicts(dctx, in.src, in.size);
+        }
 
-        /* compress and write */
-        self->input.pos = 0;
         do {
-            self->output.size = self->sizeout;
-            self->output.pos  = 0;
-            res = ZSTD_compressStream(self->cctx, &self->output, &self->input);
+            out.pos = 0;
+            res = ZSTD_decompressStream(dctx, &out, &in);
             if (ZSTD_IS_ERROR(res)) {
-                php_error_docref(NULL, E_WARNING, "libzstd error %s\n", ZSTD_getErrorName(res));
-#if PHP_VERSION_ID >= 70400
-                return -1;
-#endif
+                ZSTD_WARNING("%s", ZSTD_getErrorName(res));
+                written = -1;
+                break;
             }
-            php_stream_write(self->stream, self->bufout, self->output.pos);
-        } while (self->input.pos != self->input.size);
+            if (out.pos
+                && (size_t) php_stream_write(dst, out.dst, out.pos) != out.pos) {
+                ZSTD_WARNING("can not write destination file");
+                written = -1;
+                break;
+            }
+            written += out.pos;
+        } while (in.pos < in.size || out.pos == out.size);
+    } while (written >= 0 && !map);
 
-        self->input.pos = 0;
-        self->input.size = 0;
+    /* An empty file is not a frame, unlike the compression of one */
+    if (written >= 0 && empty) {
+        ZSTD_WARNING("it was not compressed by zstd");
+        written = -1;
+    } else if (written >= 0 && res != 0) {
+        ZSTD_WARNING("truncated input");
+        written = -1;
     }
-    return ret;
-#endif
+
+    if (map) {
+        php_stream_mmap_unmap(src);
+    } else {
+        efree(buf);
+    }
+    efree(out.dst);
+
+    return written;
 }
 
+ZEND_FUNCTION(zstd_compress_file)
+{
+    zend_long level = DEFAULT_COMPRESS_LEVEL, written;
+    zend_string *dict = NULL;
+    HashTable *options = NULL;
+    char *source, *dest;
+    size_t source_len, dest_len;
+    php_stream *src, *dst;
+    ZSTD_CCtx *cctx;
+    ZSTD_CDict *cdict = NULL;
+    int cdict_owned = 0;
+    size_t res;
+    zval *tmpzval;
 
-static php_stream_ops php_stream_zstd_read_ops = {
-    NULL,    /* write */
-    php_zstd_decomp_read,
-    php_zstd_decomp_close,
-    NULL,    /* flush */
-    STREAM_NAME,
-    NULL,    /* seek */
-    NULL,    /* cast */
-    NULL,    /* stat */
-    NULL     /* set_option */
-};
+    ZEND_PARSE_PARAMETERS_START(2, 3)
+        Z_PARAM_PATH(source, source_len)
+        Z_PARAM_PATH(dest, dest_len)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_ARRAY_HT(options)
+    ZEND_PARSE_PARAMETERS_END();
 
+    if (!zstd_file_options(options, &level, &dict)) {
+        RETURN_FALSE;
+    }
 
-static php_stream_ops php_stream_zstd_write_ops = {
-    php_zstd_comp_write,
-    NULL,    /* read */
-    php_zstd_comp_close,
-    php_zstd_comp_flush,
-    STREAM_NAME,
-    NULL,    /* seek */
-    NULL,    /* cast */
-    NULL,    /* stat */
-    NULL     /* set_option */
-};
+    cctx = ZSTD_createCCtx();
+    if (cctx == NULL) {
+        if (dict) {
+            zend_string_release(dict);
+        }
+        ZSTD_WARNING("ZSTD_createCCtx() error");
+        RETURN_FALSE;
+    }
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, (int)level);
+    if (options
+        && NULL != (tmpzval = zend_hash_str_find(options,
+                                                 ZEND_STRL("checksum")))) {
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag,
+                               zend_is_true(tmpzval));
+    }
+    if (dict) {
+        cdict = php_zstd_cdict(ZSTR_VAL(dict), ZSTR_LEN(dict), (int)level,
+                               &cdict_owned);
+        zend_string_release(dict);
+        if (cdict == NULL) {
+            ZSTD_freeCCtx(cctx);
+            ZSTD_WARNING("ZSTD_createCDict() error");
+            RETURN_FALSE;
+        }
+        res = ZSTD_CCtx_refCDict(cctx, cdict);
+        if (ZSTD_isError(res)) {
+            ZSTD_freeCCtx(cctx);
+            if (cdict_owned) {
+                ZSTD_freeCDict(cdict);
+            }
+            ZSTD_WARNING("%s", ZSTD_getErrorName(res));
+            RETURN_FALSE;
+        }
+    }
 
+    src = zstd_file_open(source, "rb");
+    dst = src ? zstd_file_open(dest, "wb") : NULL;
+    if (dst) {
+        written = zstd_file_compress(src, dst, cctx);
+        php_stream_close(dst);
+    } else {
+        written = -1;
+    }
+    if (src) {
+        php_stream_close(src);
+    }
 
-static php_stream *
-php_stream_zstd_opener(
-    php_stream_wrapper *wrapper,
-    const char *path,
-    const char *mode,
-    int options,
-    zend_string **opened_path,
-    php_stream_context *context
-    STREAMS_DC)
+    ZSTD_freeCCtx(cctx);
+    if (cdict_owned) {
+        ZSTD_freeCDict(cdict);
+    }
+
+    if (written < 0) {
+        RETURN_FALSE;
+    }
+    RETURN_LONG(written);
+}
+
+ZEND_FUNCTION(zstd_uncompress_file)
 {
-    php_zstd_stream_data *self;
-    int level = ZSTD_CLEVEL_DEFAULT;
-    int compress;
-#if ZSTD_VERSION_NUMBER >= 10400
-    ZSTD_CDict *cdict = NULL;
+    zend_long written;
+    zend_string *dict = NULL;
+    HashTable *options = NULL;
+    char *source, *dest;
+    size_t source_len, dest_len;
+    php_stream *src, *dst;
+    ZSTD_DCtx *dctx;
     ZSTD_DDict *ddict = NULL;
+    int ddict_owned = 0, dict_lookup;
+    size_t res;
+
+    ZEND_PARSE_PARAMETERS_START(2, 3)
+        Z_PARAM_PATH(source, source_len)
+        Z_PARAM_PATH(dest, dest_len)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_ARRAY_HT(options)
+    ZEND_PARSE_PARAMETERS_END();
+
+    zstd_file_options(options, NULL, &dict);
+
+    dctx = ZSTD_createDCtx();
+    if (dctx == NULL) {
+        if (dict) {
+            zend_string_release(dict);
+        }
+        ZSTD_WARNING("ZSTD_createDCtx() error");
+        RETURN_FALSE;
+    }
+    dict_lookup = (dict == NULL);
+    if (dict) {
+        ddict = php_zstd_ddict(ZSTR_VAL(dict), ZSTR_LEN(dict), &ddict_owned);
+        zend_string_release(dict);
+        if (ddict == NULL) {
+            ZSTD_freeDCtx(dctx);
+            ZSTD_WARNING("ZSTD_createDDict() error");
+            RETURN_FALSE;
+        }
+        res = ZSTD_DCtx_refDDict(dctx, ddict);
+        if (ZSTD_isError(res)) {
+            ZSTD_freeDCtx(dctx);
+            if (ddict_owned) {
+                ZSTD_freeDDict(ddict);
+            }
+            ZSTD_WARNING("%s", ZSTD_getErrorName(res));
+            RETURN_FALSE;
+        }
+    }
+
+    src = zstd_file_open(source, "rb");
+    dst = src ? zstd_file_open(dest, "wb") : NULL;
+    if (dst) {
+        written = zstd_file_uncompress(src, dst, dctx, dict_lookup);
+        php_stream_close(dst);
+    } else {
+        written = -1;
+    }
+    if (src) {
+        php_stream_close(src);
+    }
+
+    ZSTD_freeDCtx(dctx);
+    if (ddict_owned) {
+        ZSTD_freeDDict(ddict);
+    }
+
+    if (written < 0) {
+        RETURN_FALSE;
+    }
+    RETURN_LONG(written);
+}
 #endif
 
-    if (strncasecmp(STREAM_NAME, path, sizeof(STREAM_NAME)-1) == 0) {
-        path += sizeof(STREAM_NAME)-1;
-        if (strncmp("://", path, 3) == 0) {
-            path += 3;
+#if ZSTD_VERSION_NUMBER >= 10400
+#define ZSTD_BENCH_ITERATIONS 3
+#define ZSTD_BENCH_ITERATIONS_MAX 10000
+
+typedef struct _php_zstd_bench_param {
+    const char *name;
+    ZSTD_cParameter param;
+} php_zstd_bench_param;
+
+static const php_zstd_bench_param php_zstd_bench_params[] = {
+    { "window_log", ZSTD_c_windowLog },
+    { "hash_log", ZSTD_c_hashLog },
+    { "chain_log", ZSTD_c_chainLog },
+    { "search_log", ZSTD_c_searchLog },
+    { "min_match", ZSTD_c_minMatch },
+    { "target_length", ZSTD_c_targetLength },
+    { "strategy", ZSTD_c_strategy },
+    { "long", ZSTD_c_enableLongDistanceMatching },
+    { "checksum", ZSTD_c_checksumFlag },
+    { NULL, 0 }
+};
+
+typedef struct _php_zstd_bench {
+    zend_string **samples;
+    zend_string **compressed;
+    size_t count;
+    zend_long iterations;
+    zend_long flags;
+    zend_long workers;
+    HashTable *params;
+    zend_string *dict;
+    ZSTD_CCtx *cctx;
+    ZSTD_DCtx *dctx;
+    double *latencies;
+} php_zstd_bench;
+
+/* Apply the "workers" and "params" options, after each reset of cctx */
+static int php_zstd_bench_apply(php_zstd_bench *bench)
+{
+    const php_zstd_bench_param *p;
+    zend_string *name;
+    zval *value;
+    size_t res;
+
+    if (bench->workers) {
+        res = ZSTD_CCtx_setParameter(bench->cctx, ZSTD_c_nbWorkers,
+                                     (int) bench->workers);
+        if (ZSTD_IS_ERROR(res)) {
+            ZSTD_WARNING("workers: %s", ZSTD_getErrorName(res));
+            return 0;
+        }
+    }
+    if (bench->params == NULL) {
+        return 1;
+    }
+    ZEND_HASH_FOREACH_STR_KEY_VAL(bench->params, name, value) {
+        if (name == NULL) {
+            ZSTD_WARNING("params must be indexed by name");
+            return 0;
+        }
+        for (p = php_zstd_bench_params; p->name; p++) {
+            if (strcmp(ZSTR_VAL(name), p->name) == 0) {
+                break;
+            }
+        }
+        if (p->name == NULL) {
+            ZSTD_WARNING("unknown parameter '%s'", ZSTR_VAL(name));
+            return 0;
+        }
+        res = ZSTD_CCtx_setParameter(bench->cctx, p->param,
+                                     (int) zval_get_long(value));
+        if (ZSTD_IS_ERROR(res)) {
+            ZSTD_WARNING("%s: %s", p->name, ZSTD_getErrorName(res));
+            return 0;
         }
+    } ZEND_HASH_FOREACH_END();
+    return 1;
+}
+
+/* Same work as zstd_compress, or zstd_compress_dict with a dictionary */
+static zend_string *php_zstd_bench_compress(php_zstd_bench *bench,
+                                            zend_string *sample, int level)
+{
+    zend_string *output;
+    char *buf;
+    size_t size, result;
+
+    if (bench->cctx == NULL) {
+        return php_zstd_compress(ZSTR_VAL(sample), ZSTR_LEN(sample),
+                                 level, bench->flags);
     }
 
-    if (php_check_open_basedir(path)) {
+    size = ZSTD_compressBound(ZSTR_LEN(sample));
+    buf = php_zstd_output_alloc(&output, size);
+    result = ZSTD_compress2(bench->cctx, buf, size,
+                            ZSTR_VAL(sample), ZSTR_LEN(sample));
+    if (ZSTD_IS_ERROR(result)) {
+        php_zstd_output_free(output);
+        ZSTD_WARNING("%s", ZSTD_getErrorName(result));
         return NULL;
     }
+    return php_zstd_output_exact(output, buf, result);
+}
 
-    if (!strcmp(mode, "w") || !strcmp(mode, "wb") || !strcmp(mode, "a") || !strcmp(mode, "ab")) {
-       compress = 1;
-    } else if (!strcmp(mode, "r") || !strcmp(mode, "rb")) {
-       compress = 0;
-    } else {
-        php_error_docref(NULL, E_ERROR, "zstd: invalid open mode");
+/* Same work as zstd_uncompress, or zstd_uncompress_dict with a dictionary */
+static zend_string *php_zstd_bench_uncompress(php_zstd_bench *bench,
+                                              zend_string *input, size_t size)
+{
+    zend_string *output;
+    size_t result;
+
+    if (bench->dctx == NULL) {
+        return php_zstd_uncompress(ZSTR_VAL(input), ZSTR_LEN(input));
+    }
+
+    output = zend_string_alloc(size, 0);
+    result = ZSTD_decompressDCtx(bench->dctx, ZSTR_VAL(output), size,
+                                 ZSTR_VAL(input), ZSTR_LEN(input));
+    if (ZSTD_IS_ERROR(result)) {
+        zend_string_efree(output);
+        ZSTD_WARNING("%s", ZSTD_getErrorName(result));
         return NULL;
     }
+    return zstd_string_output_truncate(output, result);
+}
 
-    if (context) {
-        zval *tmpzval;
-        zend_string *data;
+static int php_zstd_bench_cmp(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
 
-        if (NULL != (tmpzval = php_stream_context_get_option(context, "zstd", "level"))) {
-            level = zval_get_long(tmpzval);
+    return (x > y) - (x < y);
+}
+
+/* Latency percentiles of the calls, in microseconds */
+static void php_zstd_bench_latency(zval *result, const char *key,
+                                   double *latencies, size_t count)
+{
+    zval latency;
+
+    qsort(latencies, count, sizeof(double), php_zstd_bench_cmp);
+
+    array_init(&latency);
+    add_assoc_double(&latency, "p50", latencies[(count - 1) / 2] * 1000000);
+    add_assoc_double(&latency, "p90",
+                     latencies[(count - 1) * 90 / 100] * 1000000);
+    add_assoc_double(&latency, "p99",
+                     latencies[(count - 1) * 99 / 100] * 1000000);
+    add_assoc_double(&latency, "max", latencies[count - 1] * 1000000);
+    add_assoc_zval(result, key, &latency);
+}
+
+static double php_zstd_bench_mbps(size_t bytes, zend_long iterations,
+                                  double time)
+{
+    if (time <= 0) {
+        return 0;
+    }
+    return (double) bytes * iterations / time / (1024 * 1024);
+}
+
+static int php_zstd_bench_level(php_zstd_bench *bench, int level,
+                                zval *result)
+{
+    ZSTD_CDict *cdict = NULL;
+    int cdict_owned = 0, ok = 1;
+    zend_string *output;
+    zend_long it;
+    size_t i, n, bytes_in = 0, bytes_out = 0;
+    double start, ctime = 0, dtime = 0;
+    zval entry;
+
+    if (bench->cctx) {
+        ZSTD_CCtx_reset(bench->cctx, ZSTD_reset_session_and_parameters);
+        ZSTD_CCtx_setParameter(bench->cctx, ZSTD_c_compressionLevel, level);
+        if (!php_zstd_bench_apply(bench)) {
+            return 0;
         }
-#if ZSTD_VERSION_NUMBER >= 10400
-        if (NULL != (tmpzval = php_stream_context_get_option(context, "zstd", "dict"))) {
-            data = zval_get_string(tmpzval);
-            if (compress) {
-                cdict = ZSTD_createCDict(ZSTR_VAL(data), ZSTR_LEN(data), level);
-            } else {
-                ddict = ZSTD_createDDict(ZSTR_VAL(data), ZSTR_LEN(data));
+        if (bench->dict) {
+            cdict = php_zstd_cdict(ZSTR_VAL(bench->dict),
+                                   ZSTR_LEN(bench->dict), level, &cdict_owned);
+            if (!cdict) {
+                ZSTD_WARNING("ZSTD_createCDict() error");
+                return 0;
             }
-            zend_string_release(data);
+            ZSTD_CCtx_refCDict(bench->cctx, cdict);
         }
-#endif
     }
 
-    if (level > ZSTD_maxCLevel()) {
-        php_error_docref(NULL, E_WARNING, "zstd: compression level (%d) must be less than %d", level, ZSTD_maxCLevel());
-        level = ZSTD_maxCLevel();
+    n = 0;
+    for (it = 0; ok && it < bench->iterations; it++) {
+        for (i = 0; i < bench->count; i++) {
+            start = php_zstd_time();
+            output = php_zstd_bench_compress(bench, bench->samples[i], level);
+            bench->latencies[n] = php_zstd_time() - start;
+            if (output == NULL) {
+                ok = 0;
+                break;
+            }
+            ctime += bench->latencies[n++];
+            if (it == 0) {
+                bytes_in += ZSTR_LEN(bench->samples[i]);
+                bytes_out += ZSTR_LEN(output);
+            }
+            if (bench->compressed[i]) {
+                zend_string_release(bench->compressed[i]);
+            }
+            bench->compressed[i] = output;
+        }
     }
 
-    self = ecalloc(sizeof(*self), 1);
-    self->stream = php_stream_open_wrapper(path, mode, options | REPORT_ERRORS, NULL);
-    if (!self->stream) {
-        efree(self);
-        return NULL;
+    if (ok) {
+        array_init(&entry);
+        add_assoc_long(&entry, "level", level);
+        add_assoc_long(&entry, "bytes_in", (zend_long) bytes_in);
+        add_assoc_long(&entry, "bytes_out", (zend_long) bytes_out);
+        add_assoc_double(&entry, "ratio",
+                         bytes_out ? (double) bytes_in / bytes_out : 0);
+        add_assoc_double(&entry, "compress_mbps",
+                         php_zstd_bench_mbps(bytes_in, bench->iterations,
+                                             ctime));
+        php_zstd_bench_latency(&entry, "compress_latency",
+                               bench->latencies, n);
+
+        n = 0;
+        for (it = 0; ok && it < bench->iterations; it++) {
+            for (i = 0; i < bench->count; i++) {
+                start = php_zstd_time();
+                output = php_zstd_bench_uncompress(bench,
+                                                   bench->compressed[i],
+                                                   ZSTR_LEN(bench->samples[i]));
+                bench->latencies[n] = php_zstd_time() - start;
+                if (output == NULL) {
+                    ok = 0;
+                    break;
+                }
+                dtime += bench->latencies[n++];
+                if (it == 0
+                    && !zend_string_equals(output, bench->samples[i])) {
+                    ZSTD_WARNING("level %d does not round trip", level);
+                    ok = 0;
+                }
+                zend_string_release(output);
+                if (!ok) {
+                    break;
+                }
+            }
+        }
+
+        if (ok) {
+            add_assoc_double(&entry, "decompress_mbps",
+                             php_zstd_bench_mbps(bytes_in, bench->iterations,
+                                                 dtime));
+            php_zstd_bench_latency(&entry, "decompress_latency",
+                                   bench->latencies, n);
+            add_next_index_zval(result, &entry);
+        } else {
+            zval_ptr_dtor(&entry);
+        }
     }
 
-    /* File */
-    if (compress) {
-        self->dctx = NULL;
-        self->cctx = ZSTD_createCCtx();
-        if (!self->cctx) {
-            php_error_docref(NULL, E_WARNING, "zstd: compression context failed");
-            php_stream_close(self->stream);
-            efree(self);
-            return NULL;
+    for (i = 0; i < bench->count; i++) {
+        if (bench->compressed[i]) {
+            zend_string_release(bench->compressed[i]);
+            bench->compressed[i] = NULL;
         }
-#if ZSTD_VERSION_NUMBER >= 10400
-        ZSTD_CCtx_reset(self->cctx, ZSTD_reset_session_only);
-        ZSTD_CCtx_refCDict(self->cctx, cdict);
-        ZSTD_CCtx_setParameter(self->cctx, ZSTD_c_compressionLevel, level);
+    }
+    if (cdict) {
+        ZSTD_CCtx_refCDict(bench->cctx, NULL);
+        if (cdict_owned) {
+            ZSTD_freeCDict(cdict);
+        }
+    }
+    return ok;
+}
 
-        self->output.size = ZSTD_CStreamOutSize();
-        self->output.dst  = emalloc(self->output.size);
-        self->output.pos  = 0;
+static int php_zstd_bench_options(php_zstd_bench *bench, HashTable *options)
+{
+    zval *tmpzval;
 
-#else
-        ZSTD_initCStream(self->cctx, level);
+    if (options == NULL) {
+        return 1;
+    }
+    if (NULL != (tmpzval = zend_hash_str_find(options,
+                                              ZEND_STRL("iterations")))) {
+        bench->iterations = zval_get_long(tmpzval);
+        if (bench->iterations <= 0) {
+            ZSTD_WARNING("iterations (" ZEND_LONG_FMT ")"
+                         " must be greater than 0", bench->iterations);
+            return 0;
+        } else if (bench->iterations > ZSTD_BENCH_ITERATIONS_MAX) {
+            ZSTD_WARNING("iterations (" ZEND_LONG_FMT ")"
+                         " must not be greater than %d",
+                         bench->iterations, ZSTD_BENCH_ITERATIONS_MAX);
+            return 0;
+        }
+    }
+    if (NULL != (tmpzval = zend_hash_str_find(options, ZEND_STRL("flags")))) {
+        bench->flags = zval_get_long(tmpzval);
+    }
+    if (NULL != (tmpzval = zend_hash_str_find(options,
+                                              ZEND_STRL("workers")))) {
+        bench->workers = zval_get_long(tmpzval);
+        if (bench->workers < 0) {
+            ZSTD_WARNING("workers (" ZEND_LONG_FMT ")"
+                         " must be greater than or equal to 0",
+                         bench->workers);
+            return 0;
+        }
+    }
+    if (NULL != (tmpzval = zend_hash_str_find(options, ZEND_STRL("params")))) {
+        if (Z_TYPE_P(tmpzval) != IS_ARRAY) {
+            ZSTD_WARNING("params must be an array");
+            return 0;
+        }
+        bench->params = Z_ARRVAL_P(tmpzval);
+    }
+    if (NULL != (tmpzval = zend_hash_str_find(options, ZEND_STRL("dict")))) {
+        bench->dict = zval_get_string(tmpzval);
+    }
+    if (bench->flags
+        && (bench->dict || bench->workers || bench->params)) {
+        ZSTD_WARNING("flags can not be used with dict, workers or params");
+        return 0;
+    }
+    return 1;
+}
 
-        self->bufin = emalloc(self->sizein = ZSTD_CStreamInSize());
-        self->bufout = emalloc(self->sizeout = ZSTD_CStreamOutSize());
-        self->input.src  = self->bufin;
-        self->input.pos   = 0;
-        self->input.size  = 0;
-        self->output.dst = self->bufout;
-        self->output.pos  = 0;
-        self->output.size = 0;
-#endif
+ZEND_FUNCTION(zstd_bench)
+{
+    zval *samples, *tmpzval, levels_default;
+    HashTable *levels = NULL, *options = NULL;
+    php_zstd_bench bench;
+    ZSTD_DDict *ddict = NULL;
+    int ddict_owned = 0, ok;
+    size_t i;
+    zend_long level;
 
-        return php_stream_alloc(&php_stream_zstd_write_ops, self, NULL, mode);
+    ZEND_PARSE_PARAMETERS_START(1, 3)
+        Z_PARAM_ZVAL(samples)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_ARRAY_HT(levels)
+        Z_PARAM_ARRAY_HT(options)
+    ZEND_PARSE_PARAMETERS_END();
+
+    memset(&bench, 0, sizeof(bench));
+    bench.iterations = ZSTD_BENCH_ITERATIONS;
 
+    if (Z_TYPE_P(samples) == IS_ARRAY) {
+        bench.count = zend_hash_num_elements(Z_ARRVAL_P(samples));
+    } else if (Z_TYPE_P(samples) == IS_STRING) {
+        bench.count = 1;
     } else {
-        self->dctx = ZSTD_createDCtx();
-        if (!self->dctx) {
-            php_error_docref(NULL, E_WARNING, "zstd: compression context failed");
-            php_stream_close(self->stream);
-            efree(self);
-            return NULL;
+        ZSTD_WARNING("samples must be a string or an array of strings");
+        RETURN_FALSE;
+    }
+    if (bench.count == 0) {
+        ZSTD_WARNING("samples must not be empty");
+        RETURN_FALSE;
+    }
+
+    ZVAL_UNDEF(&levels_default);
+    if (levels == NULL || zend_hash_num_elements(levels) == 0) {
+        array_init(&levels_default);
+        add_next_index_long(&levels_default, DEFAULT_COMPRESS_LEVEL);
+        levels = Z_ARRVAL(levels_default);
+    }
+    ZEND_HASH_FOREACH_VAL(levels, tmpzval) {
+        if (!zstd_check_compress_level(zval_get_long(tmpzval))) {
+            zval_ptr_dtor(&levels_default);
+            RETURN_FALSE;
         }
-        self->cctx = NULL;
-        self->bufin = emalloc(self->sizein = ZSTD_DStreamInSize());
-        self->bufout = emalloc(self->sizeout = ZSTD_DStreamOutSize());
-#if ZSTD_VERSION_NUMBER >= 10400
-        ZSTD_DCtx_reset(self->dctx, ZSTD_reset_session_only);
-        ZSTD_DCtx_refDDict(self->dctx, ddict);
-#else
-        ZSTD_initDStream(self->dctx);
-#endif
-        self->input.src   = self->bufin;
-        self->input.pos   = 0;
-        self->input.size  = 0;
-        self->output.dst  = self->bufout;
-        self->output.pos  = 0;
-        self->output.size = 0;
+    } ZEND_HASH_FOREACH_END();
 
-        return php_stream_alloc(&php_stream_zstd_read_ops, self, NULL, mode);
+    if (!php_zstd_bench_options(&bench, options)) {
+        if (bench.dict) {
+            zend_string_release(bench.dict);
+        }
+        zval_ptr_dtor(&levels_default);
+        RETURN_FALSE;
     }
-}
 
+    if (bench.dict || bench.workers || bench.params) {
+        bench.cctx = ZSTD_createCCtx();
+        if (bench.cctx == NULL) {
+            ZSTD_WARNING("ZSTD_createCCtx() error");
+        }
+    }
+    if (bench.dict) {
+        ddict = php_zstd_ddict(ZSTR_VAL(bench.dict), ZSTR_LEN(bench.dict),
+                               &ddict_owned);
+        bench.dctx = ZSTD_createDCtx();
+        if (ddict == NULL || bench.dctx == NULL) {
+            ZSTD_WARNING("ZSTD_createDDict() error");
+        } else {
+            ZSTD_DCtx_refDDict(bench.dctx, ddict);
+        }
+    }
+    ok = !(bench.dict || bench.workers || bench.params) || bench.cctx;
+    ok = ok && (!bench.dict || (ddict && bench.dctx));
+
+    if (ok) {
+        php_zstd_stats stats = PHP_ZSTD_G(stats);
+
+        bench.samples = safe_emalloc(bench.count, sizeof(zend_string *), 0);
+        bench.compressed = ecalloc(bench.count, sizeof(zend_string *));
+        /* iterations is bounded, so only the count can overflow */
+        bench.latencies = safe_emalloc(bench.count,
+                                       (size_t) bench.iterations
+                                       * sizeof(double), 0);
+        if (Z_TYPE_P(samples) == IS_ARRAY) {
+            i = 0;
+            ZEND_HASH_FOREACH_VAL(Z_ARRVAL_P(samples), tmpzval) {
+                bench.samples[i++] = zval_get_string(tmpzval);
+            } ZEND_HASH_FOREACH_END();
+        } else {
+            bench.samples[0] = zend_string_copy(Z_STR_P(samples));
+        }
 
-static php_stream_wrapper_ops zstd_stream_wops = {
-    php_stream_zstd_opener,
-    NULL,    /* close */
-    NULL,    /* fstat */
-    NULL,    /* stat */
-    NULL,    /* opendir */
-    STREAM_NAME,
-    NULL,    /* unlink */
-    NULL,    /* rename */
-    NULL,    /* mkdir */
-    NULL,    /* rmdir */
-    NULL
-};
+        array_init(return_value);
+        ZEND_HASH_FOREACH_VAL(levels, tmpzval) {
+            level = zval_get_long(tmpzval);
+            if (!php_zstd_bench_level(&bench, (int) level, return_value)) {
+                ok = 0;
+                break;
+            }
+        } ZEND_HASH_FOREACH_END();
 
+        /* Benchmark rounds are not accounted in zstd_stats() */
+        PHP_ZSTD_G(stats) = stats;
 
-php_stream_wrapper php_stream_zstd_wrapper = {
-    &zstd_stream_wops,
-    NULL,
-    0 /* is_url */
-};
+        for (i = 0; i < bench.count; i++) {
+            zend_string_release(bench.samples[i]);
+        }
+        efree(bench.samples);
+        efree(bench.compressed);
+        efree(bench.latencies);
+    }
+
+    if (bench.cctx) {
+        ZSTD_freeCCtx(bench.cctx);
+    }
+    if (bench.dctx) {
+        ZSTD_freeDCtx(bench.dctx);
+    }
+    if (ddict && ddict_owned) {
+        ZSTD_freeDDict(ddict);
+    }
+    if (bench.dict) {
+        zend_string_release(bench.dict);
+    }
+    zval_ptr_dtor(&levels_default);
+
+    if (!ok) {
+        zval_ptr_dtor(return_value);
+        RETURN_FALSE;
+    }
+}
+#endif
 
 #if defined(HAVE_APCU_SUPPORT)
-static int APC_SERIALIZER_NAME(zstd)(APC_SERIALIZER_ARGS)
+static int php_zstd_apcu_serialize(unsigned char **buf, size_t *buf_len,
+                                   const zval *value, zend_long flags)
 {
     int result;
     php_serialize_data_t var_hash;
     size_t size;
     smart_str var = {0};
+    php_zstd_dict *dict;
+    char *dst, *scratch;
 
     PHP_VAR_SERIALIZE_INIT(var_hash);
     php_var_serialize(&var, (zval*) value, &var_hash);
@@ -854,26 +4518,65 @@ static int APC_SERIALIZER_NAME(zstd)(APC_SERIALIZER_ARGS)
         return 0;
     }
 
+    /* APCu copies the result to shared memory and frees it, compress
+     * into the scratch buffer and hand over an exact size copy */
     size = ZSTD_compressBound(ZSTR_LEN(var.s));
-    *buf = emalloc(size + 1);
+    scratch = php_zstd_scratch_acquire(size + 1);
+    dst = scratch ? scratch : emalloc(size + 1);
 
-    *buf_len = ZSTD_compress(*buf, size, ZSTR_VAL(var.s), ZSTR_LEN(var.s),
-                             DEFAULT_COMPRESS_LEVEL);
+    dict = php_zstd_dict_find(PHP_ZSTD_G(apcu_dictionary),
+                              strlen(PHP_ZSTD_G(apcu_dictionary)));
+#if ZSTD_VERSION_NUMBER >= 10400
+    if (flags & PHP_ZSTD_COMPRESS_COMPACT) {
+        *buf_len = php_zstd_compress_compact(dst, size + 1,
+                                             ZSTR_VAL(var.s),
+                                             ZSTR_LEN(var.s),
+                                             DEFAULT_COMPRESS_LEVEL,
+                                             dict ? dict->cdict : NULL, 0);
+    } else
+#endif
+    if (dict) {
+        ZSTD_CCtx *cctx = ZSTD_createCCtx();
+        if (cctx == NULL) {
+            *buf_len = 0;
+        } else {
+            *buf_len = ZSTD_compress_usingCDict(cctx, dst, size,
+                                                ZSTR_VAL(var.s),
+                                                ZSTR_LEN(var.s),
+                                                dict->cdict);
+            ZSTD_freeCCtx(cctx);
+        }
+    } else {
+        *buf_len = ZSTD_compress(dst, size, ZSTR_VAL(var.s), ZSTR_LEN(var.s),
+                                 DEFAULT_COMPRESS_LEVEL);
+    }
     if (ZSTD_isError(*buf_len) || *buf_len == 0) {
-        efree(*buf);
         *buf = NULL;
         *buf_len = 0;
         result = 0;
+    } else if (scratch) {
+        *buf = emalloc(*buf_len);
+        memcpy(*buf, dst, *buf_len);
+        result = 1;
     } else {
+        *buf = (unsigned char *) dst;
+        dst = NULL;
         result = 1;
     }
 
+    if (scratch) {
+        php_zstd_scratch_release();
+    } else if (dst) {
+        efree(dst);
+    }
+
     smart_str_free(&var);
 
     return result;
 }
 
-static int APC_UNSERIALIZER_NAME(zstd)(APC_UNSERIALIZER_ARGS)
+static int php_zstd_apcu_unserialize(zval *value, const unsigned char *buf,
+                                     size_t buf_len)
 {
     const unsigned char* tmp;
     int result;
@@ -881,21 +4584,60 @@ static int APC_UNSERIALIZER_NAME(zstd)(APC_UNSERIALIZER_ARGS)
     size_t var_len;
     uint64_t size;
     unsigned char* var;
+    php_zstd_dict *dict;
+    zend_string *output = NULL;
 
-    size = ZSTD_getFrameContentSize(buf, buf_len);
-    if (size == ZSTD_CONTENTSIZE_ERROR
-        || size == ZSTD_CONTENTSIZE_UNKNOWN) {
-        ZVAL_NULL(value);
-        return 0;
-    }
+#if ZSTD_VERSION_NUMBER >= 10400
+    if (zstd_is_compact((const char *) buf, buf_len)) {
+        /* Compact frames carry no dictionary ID */
+        dict = php_zstd_dict_find(PHP_ZSTD_G(apcu_dictionary),
+                                  strlen(PHP_ZSTD_G(apcu_dictionary)));
+        output = php_zstd_uncompress_compact((const char *) buf, buf_len,
+                                             dict ? dict->ddict : NULL);
+        if (output == NULL || ZSTR_LEN(output) == 0) {
+            if (output) {
+                zend_string_efree(output);
+            }
+            ZVAL_NULL(value);
+            return 0;
+        }
+        /* Unserialized from the decompressed string itself */
+        var_len = ZSTR_LEN(output);
+        var = (unsigned char*) ZSTR_VAL(output);
+    } else
+#endif
+    {
+        /* Values are stored as a single frame, its dictionary ID picks
+         * the dictionary */
+        size = ZSTD_getFrameContentSize(buf, buf_len);
+        if (size == ZSTD_CONTENTSIZE_ERROR
+            || size == ZSTD_CONTENTSIZE_UNKNOWN
+            || ZSTD_findFrameCompressedSize(buf, buf_len) != buf_len) {
+            ZVAL_NULL(value);
+            return 0;
+        }
 
-    var = (unsigned char*) emalloc(size);
+        var = (unsigned char*) emalloc(size);
 
-    var_len = ZSTD_decompress(var, size, buf, buf_len);
-    if (ZSTD_isError(var_len) || var_len == 0) {
-        efree(var);
-        ZVAL_NULL(value);
-        return 0;
+        dict = php_zstd_dict_find_id(ZSTD_getDictID_fromFrame(buf, buf_len));
+        if (dict) {
+            ZSTD_DCtx *dctx = ZSTD_createDCtx();
+            if (dctx == NULL) {
+                var_len = 0;
+            } else {
+                var_len = ZSTD_decompress_usingDDict(dctx, var, size,
+                                                     buf, buf_len,
+                                                     dict->ddict);
+                ZSTD_freeDCtx(dctx);
+            }
+        } else {
+            var_len = ZSTD_decompress(var, size, buf, buf_len);
+        }
+        if (ZSTD_isError(var_len) || var_len == 0) {
+            efree(var);
+            ZVAL_NULL(value);
+            return 0;
+        }
     }
 
     PHP_VAR_UNSERIALIZE_INIT(var_hash);
@@ -914,14 +4656,86 @@ static int APC_UNSERIALIZER_NAME(zstd)(APC_UNSERIALIZER_ARGS)
         result = 1;
     }
 
-    efree(var);
+    if (output) {
+        zend_string_efree(output);
+    } else {
+        efree(var);
+    }
 
     return result;
 }
+
+static int APC_SERIALIZER_NAME(zstd)(APC_SERIALIZER_ARGS)
+{
+    return php_zstd_apcu_serialize(buf, buf_len, value, 0);
+}
+
+static int APC_UNSERIALIZER_NAME(zstd)(APC_UNSERIALIZER_ARGS)
+{
+    return php_zstd_apcu_unserialize(value, buf, buf_len);
+}
+
+#if ZSTD_VERSION_NUMBER >= 10400
+static int APC_SERIALIZER_NAME(zstd_compact)(APC_SERIALIZER_ARGS)
+{
+    return php_zstd_apcu_serialize(buf, buf_len, value,
+                                   PHP_ZSTD_COMPRESS_COMPACT);
+}
+
+static int APC_UNSERIALIZER_NAME(zstd_compact)(APC_UNSERIALIZER_ARGS)
+{
+    return php_zstd_apcu_unserialize(value, buf, buf_len);
+}
+#endif
+#endif
+
+static ZEND_GINIT_FUNCTION(zstd)
+{
+#if defined(COMPILE_DL_ZSTD) && defined(ZTS)
+    ZEND_TSRMLS_CACHE_UPDATE();
 #endif
+    memset(zstd_globals, 0, sizeof(*zstd_globals));
+    zend_hash_init(&zstd_globals->registered_dicts, 0, NULL,
+                   php_zstd_dict_free, 1);
+    zend_hash_init(&zstd_globals->memo, 0, NULL, NULL, 1);
+    zend_hash_init(&zstd_globals->memo_dicts, 0, NULL,
+                   php_zstd_memo_dict_free, 1);
+}
+
+static ZEND_GSHUTDOWN_FUNCTION(zstd)
+{
+    php_zstd_memo *entry, *next;
+
+    for (entry = zstd_globals->memo_head; entry; entry = next) {
+        next = entry->next;
+        php_zstd_memo_free(entry);
+    }
+    zend_hash_destroy(&zstd_globals->memo);
+    zend_hash_destroy(&zstd_globals->memo_dicts);
+    zend_hash_destroy(&zstd_globals->registered_dicts);
+    ZSTD_freeCCtx(zstd_globals->cctx);
+    ZSTD_freeDCtx(zstd_globals->dctx);
+}
 
 ZEND_MINIT_FUNCTION(zstd)
 {
+#if defined(HAVE_LIBZSTD)
+    if (ZSTD_versionNumber() != ZSTD_VERSION_NUMBER) {
+        zend_error(E_WARNING,
+                   "zstd: built against libzstd %d but %u is loaded, "
+                   "rebuild the extension", ZSTD_VERSION_NUMBER,
+                   ZSTD_versionNumber());
+        return FAILURE;
+    }
+#endif
+
+    REGISTER_INI_ENTRIES();
+
+    zend_hash_init(&php_zstd_dicts, 0, NULL, php_zstd_dict_free, 1);
+    if (PHP_ZSTD_G(dictionaries) && *PHP_ZSTD_G(dictionaries)) {
+        php_zstd_dicts_load(PHP_ZSTD_G(dictionaries));
+    }
+
     REGISTER_LONG_CONSTANT("ZSTD_COMPRESS_LEVEL_MIN",
                            1,
                            CONST_CS | CONST_PERSISTENT);
@@ -932,6 +4746,18 @@ ZEND_MINIT_FUNCTION(zstd)
                            DEFAULT_COMPRESS_LEVEL,
                            CONST_CS | CONST_PERSISTENT);
 
+#if ZSTD_VERSION_NUMBER >= 10400
+    REGISTER_LONG_CONSTANT("ZSTD_COMPRESS_COMPACT",
+                           PHP_ZSTD_COMPRESS_COMPACT,
+                           CONST_CS | CONST_PERSISTENT);
+    REGISTER_LONG_CONSTANT("ZSTD_COMPRESS_CHECKSUM",
+                           PHP_ZSTD_COMPRESS_CHECKSUM,
+                           CONST_CS | CONST_PERSISTENT);
+#endif
+    REGISTER_LONG_CONSTANT("ZSTD_COMPRESS_DETECT_INCOMPRESSIBLE",
+                           PHP_ZSTD_COMPRESS_DETECT_INCOMPRESSIBLE,
+                           CONST_CS | CONST_PERSISTENT);
+
     REGISTER_LONG_CONSTANT("LIBZSTD_VERSION_NUMBER",
                            ZSTD_VERSION_NUMBER,
                            CONST_CS | CONST_PERSISTENT);
@@ -941,18 +4767,68 @@ ZEND_MINIT_FUNCTION(zstd)
 
     php_register_url_stream_wrapper(STREAM_NAME, &php_stream_zstd_wrapper);
 
+    php_zstd_chunks_register();
+    php_zstd_compressed_register();
+
 #if defined(HAVE_APCU_SUPPORT)
     apc_register_serializer("zstd",
                             APC_SERIALIZER_NAME(zstd),
                             APC_UNSERIALIZER_NAME(zstd),
                             NULL);
+#if ZSTD_VERSION_NUMBER >= 10400
+    apc_register_serializer("zstd_compact",
+                            APC_SERIALIZER_NAME(zstd_compact),
+                            APC_UNSERIALIZER_NAME(zstd_compact),
+                            NULL);
+#endif
 #endif
 
     return SUCCESS;
 }
 
+ZEND_RSHUTDOWN_FUNCTION(zstd)
+{
+    smart_str_free(&PHP_ZSTD_G(serialize_buf));
+    if (PHP_ZSTD_G(scratch)) {
+        efree(PHP_ZSTD_G(scratch));
+        PHP_ZSTD_G(scratch) = NULL;
+        PHP_ZSTD_G(scratch_size) = 0;
+    }
+    /* Left set by a bailout while the buffers were held */
+    PHP_ZSTD_G(serialize_busy) = 0;
+    PHP_ZSTD_G(scratch_busy) = 0;
+    php_zstd_memo_locals_drop(1);
+
+    return SUCCESS;
+}
+
+/* Buffers allocated after RSHUTDOWN, by the serializers of other
+ * extensions, are released with the request memory */
+ZEND_MODULE_POST_ZEND_DEACTIVATE_D(zstd)
+{
+    memset(&PHP_ZSTD_G(serialize_buf), 0, sizeof(smart_str));
+    PHP_ZSTD_G(serialize_busy) = 0;
+    PHP_ZSTD_G(scratch) = NULL;
+    PHP_ZSTD_G(scratch_size) = 0;
+    PHP_ZSTD_G(scratch_busy) = 0;
+    php_zstd_memo_locals_drop(0);
+
+    return SUCCESS;
+}
+
+ZEND_MSHUTDOWN_FUNCTION(zstd)
+{
+    zend_hash_destroy(&php_zstd_dicts);
+
+    UNREGISTER_INI_ENTRIES();
+
+    return SUCCESS;
+}
+
 ZEND_MINFO_FUNCTION(zstd)
 {
+    char dicts[32];
+
     php_info_print_table_start();
     php_info_print_table_row(2, "Zstd support", "enabled");
     php_info_print_table_row(2, "Extension Version", PHP_ZSTD_VERSION);
@@ -960,13 +4836,24 @@ ZEND_MINFO_FUNCTION(zstd)
 #if defined(HAVE_APCU_SUPPORT)
     php_info_print_table_row(2, "APCu serializer ABI", APC_SERIALIZER_ABI);
 #endif
+    snprintf(dicts, sizeof(dicts), "%u",
+             zend_hash_num_elements(&php_zstd_dicts));
+    php_info_print_table_row(2, "Preloaded dictionaries", dicts);
     php_info_print_table_end();
+
+    DISPLAY_INI_ENTRIES();
 }
 
 static zend_function_entry zstd_functions[] = {
     ZEND_FE(zstd_compress, arginfo_zstd_compress)
     ZEND_FE(zstd_uncompress, arginfo_zstd_uncompress)
     ZEND_FALIAS(zstd_decompress, zstd_uncompress, arginfo_zstd_uncompress)
+    ZEND_FE(zstd_uncompress_parallel, arginfo_zstd_uncompress_parallel)
+    ZEND_FALIAS(zstd_decompress_parallel,
+                zstd_uncompress_parallel, arginfo_zstd_uncompress_parallel)
+    ZEND_FE(zstd_uncompress_chunks, arginfo_zstd_uncompress_chunks)
+    ZEND_FALIAS(zstd_decompress_chunks,
+                zstd_uncompress_chunks, arginfo_zstd_uncompress_chunks)
 
     ZEND_FE(zstd_compress_dict, arginfo_zstd_compress_dict)
     ZEND_FE(zstd_uncompress_dict, arginfo_zstd_uncompress_dict)
@@ -979,12 +4866,44 @@ static zend_function_entry zstd_functions[] = {
     ZEND_FALIAS(zstd_decompress_usingcdict,
                 zstd_uncompress_dict, arginfo_zstd_uncompress_dict)
 
+#if ZSTD_VERSION_NUMBER >= 10400
+    ZEND_FE(zstd_compress_delta, arginfo_zstd_compress_delta)
+    ZEND_FE(zstd_uncompress_delta, arginfo_zstd_uncompress_delta)
+    ZEND_FALIAS(zstd_decompress_delta,
+                zstd_uncompress_delta, arginfo_zstd_uncompress_delta)
+
+    ZEND_FE(zstd_compress_file, arginfo_zstd_compress_file)
+    ZEND_FE(zstd_uncompress_file, arginfo_zstd_uncompress_file)
+    ZEND_FALIAS(zstd_decompress_file,
+                zstd_uncompress_file, arginfo_zstd_uncompress_file)
+#endif
+
+    ZEND_FE(zstd_get_frame_info, arginfo_zstd_get_frame_info)
+    ZEND_FE(zstd_frame_checksum, arginfo_zstd_frame_checksum)
+    ZEND_FE(zstd_dict_register, arginfo_zstd_dict_register)
+#if ZSTD_VERSION_NUMBER >= 10400
+    ZEND_FE(zstd_serialize, arginfo_zstd_serialize)
+    ZEND_FE(zstd_unserialize, arginfo_zstd_unserialize)
+#endif
+    ZEND_FE(zstd_stats, arginfo_zstd_stats)
+#if ZSTD_VERSION_NUMBER >= 10400
+    ZEND_FE(zstd_bench, arginfo_zstd_bench)
+#endif
+
     ZEND_NS_FALIAS(PHP_ZSTD_NS, compress,
                    zstd_compress, arginfo_zstd_compress)
     ZEND_NS_FALIAS(PHP_ZSTD_NS, uncompress,
                    zstd_uncompress, arginfo_zstd_uncompress)
     ZEND_NS_FALIAS(PHP_ZSTD_NS, decompress,
                    zstd_uncompress, arginfo_zstd_uncompress)
+    ZEND_NS_FALIAS(PHP_ZSTD_NS, uncompress_parallel,
+                   zstd_uncompress_parallel, arginfo_zstd_uncompress_parallel)
+    ZEND_NS_FALIAS(PHP_ZSTD_NS, decompress_parallel,
+                   zstd_uncompress_parallel, arginfo_zstd_uncompress_parallel)
+    ZEND_NS_FALIAS(PHP_ZSTD_NS, uncompress_chunks,
+                   zstd_uncompress_chunks, arginfo_zstd_uncompress_chunks)
+    ZEND_NS_FALIAS(PHP_ZSTD_NS, decompress_chunks,
+                   zstd_uncompress_chunks, arginfo_zstd_uncompress_chunks)
     ZEND_NS_FALIAS(PHP_ZSTD_NS, compress_dict,
                    zstd_compress_dict, arginfo_zstd_compress_dict)
     ZEND_NS_FALIAS(PHP_ZSTD_NS, compress_usingcdict,
@@ -997,6 +4916,38 @@ static zend_function_entry zstd_functions[] = {
                    zstd_uncompress_dict, arginfo_zstd_uncompress_dict)
     ZEND_NS_FALIAS(PHP_ZSTD_NS, decompress_usingcdict,
                    zstd_uncompress_dict, arginfo_zstd_uncompress_dict)
+#if ZSTD_VERSION_NUMBER >= 10400
+    ZEND_NS_FALIAS(PHP_ZSTD_NS, compress_delta,
+                   zstd_compress_delta, arginfo_zstd_compress_delta)
+    ZEND_NS_FALIAS(PHP_ZSTD_NS, uncompress_delta,
+                   zstd_uncompress_delta, arginfo_zstd_uncompress_delta)
+    ZEND_NS_FALIAS(PHP_ZSTD_NS, decompress_delta,
+                   zstd_uncompress_delta, arginfo_zstd_uncompress_delta)
+    ZEND_NS_FALIAS(PHP_ZSTD_NS, compress_file,
+                   zstd_compress_file, arginfo_zstd_compress_file)
+    ZEND_NS_FALIAS(PHP_ZSTD_NS, uncompress_file,
+                   zstd_uncompress_file, arginfo_zstd_uncompress_file)
+    ZEND_NS_FALIAS(PHP_ZSTD_NS, decompress_file,
+                   zstd_uncompress_file, arginfo_zstd_uncompress_file)
+#endif
+    ZEND_NS_FALIAS(PHP_ZSTD_NS, get_frame_info,
+                   zstd_get_frame_info, arginfo_zstd_get_frame_info)
+    ZEND_NS_FALIAS(PHP_ZSTD_NS, frame_checksum,
+                   zstd_frame_checksum, arginfo_zstd_frame_checksum)
+    ZEND_NS_FALIAS(PHP_ZSTD_NS, dict_register,
+                   zstd_dict_register, arginfo_zstd_dict_register)
+#if ZSTD_VERSION_NUMBER >= 10400
+    ZEND_NS_FALIAS(PHP_ZSTD_NS, serialize,
+                   zstd_serialize, arginfo_zstd_serialize)
+    ZEND_NS_FALIAS(PHP_ZSTD_NS, unserialize,
+                   zstd_unserialize, arginfo_zstd_unserialize)
+#endif
+    ZEND_NS_FALIAS(PHP_ZSTD_NS, stats,
+                   zstd_stats, arginfo_zstd_stats)
+#if ZSTD_VERSION_NUMBER >= 10400
+    ZEND_NS_FALIAS(PHP_ZSTD_NS, bench,
+                   zstd_bench, arginfo_zstd_bench)
+#endif
 
     {NULL, NULL, NULL}
 };
@@ -1019,14 +4970,21 @@ zend_module_entry zstd_module_entry = {
     "zstd",
     zstd_functions,
     ZEND_MINIT(zstd),
+    ZEND_MSHUTDOWN(zstd),
     NULL,
-    NULL,
-    NULL,
+    ZEND_RSHUTDOWN(zstd),
     ZEND_MINFO(zstd),
     PHP_ZSTD_VERSION,
-    STANDARD_MODULE_PROPERTIES
+    PHP_MODULE_GLOBALS(zstd),
+    PHP_GINIT(zstd),
+    PHP_GSHUTDOWN(zstd),
+    ZEND_MODULE_POST_ZEND_DEACTIVATE_N(zstd),
+    STANDARD_MODULE_PROPERTIES_EX
 };
 
 #ifdef COMPILE_DL_ZSTD
+#ifdef ZTS
+ZEND_TSRMLS_CACHE_DEFINE()
+#endif
 ZEND_GET_MODULE(zstd)
 #endif
@@ -2,24 +2,105 @@
 
 namespace {
 
-  function zstd_compress(string $data, int $level = 3): string|false {}
+  function zstd_compress(string $data, int $level = 3, int $flags = 0): string|false {}
 
   function zstd_uncompress(string $data): string|false {}
 
-  function zstd_compress_dict(string $data, string $dict, int $level = DEFAULT_COMPRESS_LEVEL): string|false {}
+  function zstd_uncompress_parallel(string $data, int $workers = 0): string|false {}
+
+  function zstd_uncompress_chunks(string $data, int $chunkSize): \Zstd\UncompressChunks|false {}
+
+  function zstd_compress_dict(string $data, string $dict, int $level = DEFAULT_COMPRESS_LEVEL, int $flags = 0): string|false {}
 
   function zstd_uncompress_dict(string $data, string $dict): string|false {}
 
+  function zstd_compress_delta(string $data, string $base, int $level = 3): string|false {}
+
+  function zstd_uncompress_delta(string $data, string $base): string|false {}
+
+  function zstd_compress_file(string $source, string $dest, array $options = []): int|false {}
+
+  function zstd_uncompress_file(string $source, string $dest, array $options = []): int|false {}
+
+  function zstd_get_frame_info(string $data): array|false {}
+
+  function zstd_frame_checksum(string $data): int|null|false {}
+
+  function zstd_dict_register(string $dict): int|false {}
+
+  function zstd_serialize(mixed $value, int $level = 3, ?string $dict = null): string|false {}
+
+  function zstd_unserialize(string $data, array $options = []): mixed {}
+
+  function zstd_stats(): array {}
+
+  function zstd_bench(array|string $samples, array $levels = [3], array $options = []): array|false {}
+
 }
 
 namespace Zstd {
 
-  function compress(string $data, int $level = 3): string|false {}
+  function compress(string $data, int $level = 3, int $flags = 0): string|false {}
 
   function uncompress(string $data): string|false {}
 
-  function compress_dict(string $data, string $dict, int $level = 3): string|false {}
+  function uncompress_parallel(string $data, int $workers = 0): string|false {}
+
+  function uncompress_chunks(string $data, int $chunkSize): UncompressChunks|false {}
+
+  function compress_dict(string $data, string $dict, int $level = 3, int $flags = 0): string|false {}
 
   function uncompress_dict(string $data, string $dict): string|false {}
 
+  function compress_delta(string $data, string $base, int $level = 3): string|false {}
+
+  function uncompress_delta(string $data, string $base): string|false {}
+
+  function compress_file(string $source, string $dest, array $options = []): int|false {}
+
+  function uncompress_file(string $source, string $dest, array $options = []): int|false {}
+
+  function get_frame_info(string $data): array|false {}
+
+  function frame_checksum(string $data): int|null|false {}
+
+  function dict_register(string $dict): int|false {}
+
+  function serialize(mixed $value, int $level = 3, ?string $dict = null): string|false {}
+
+  function unserialize(string $data, array $options = []): mixed {}
+
+  function stats(): array {}
+
+  function bench(array|string $samples, array $levels = [3], array $options = []): array|false {}
+
+  /** @not-serializable */
+  final class UncompressChunks implements \Traversable
+  {
+    private function __construct() {}
+  }
+
+  final class CompressedString
+  {
+    public function __construct(string $data, bool $cache = true) {}
+
+    public static function compress(string $data, int $level = 3, int $flags = 0, bool $cache = true): CompressedString|false {}
+
+    public function getContents(): string|false {}
+
+    public function __toString(): string {}
+
+    public function getCompressed(): string {}
+
+    public function getSize(): ?int {}
+
+    public function getFrameInfo(): array|false {}
+
+    public function isCached(): bool {}
+
+    public function __serialize(): array {}
+
+    public function __unserialize(array $data): void {}
+  }
+
 }